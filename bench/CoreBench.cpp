@@ -0,0 +1,253 @@
+// Hot paths of the pipeline on synthetic data, no media files needed
+
+#include <benchmark/benchmark.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "SDL2/SDL.h"
+#include "xplayer/AVQueue.h"
+#include "xplayer/AudioTempo.h"
+#include "xplayer/Converter.h"
+#include "xplayer/FFmpegUtil.h"
+#include "xplayer/Log.h"
+#include "xplayer/Resampler.h"
+
+namespace {
+
+AVFramePtr makeVideoFrame(int width, int height, AVPixelFormat format) {
+  AVFramePtr pFrame = makeAVFrame();
+  pFrame->width = width;
+  pFrame->height = height;
+  pFrame->format = format;
+  av_frame_get_buffer(pFrame.get(), 0);
+  // a gradient, flat planes are faster to scale than real pictures
+  for (int plane = 0; plane < AV_NUM_DATA_POINTERS && pFrame->data[plane];
+       plane++)
+    for (int y = 0; y < pFrame->height; y++)
+      for (int x = 0; x < pFrame->linesize[plane]; x++)
+        pFrame->data[plane][(ptrdiff_t)y * pFrame->linesize[plane] + x] =
+            (uint8_t)(x + y * 3 + plane * 50);
+  return pFrame;
+}
+
+AVFramePtr makeAudioFrame(int samples, int sampleRate, int channels) {
+  AVFramePtr pFrame = makeAVFrame();
+  pFrame->nb_samples = samples;
+  pFrame->sample_rate = sampleRate;
+  pFrame->channels = channels;
+  pFrame->channel_layout = av_get_default_channel_layout(channels);
+  pFrame->format = AV_SAMPLE_FMT_FLTP;
+  pFrame->pts = 0;
+  av_frame_get_buffer(pFrame.get(), 0);
+  for (int ch = 0; ch < channels; ch++) {
+    auto *data = reinterpret_cast<float *>(pFrame->extended_data[ch]);
+    for (int i = 0; i < samples; i++)
+      data[i] = 0.5f * std::sin(2 * M_PI * 440.0 * i / sampleRate);
+  }
+  return pFrame;
+}
+
+}  // namespace
+
+// the queue cost alone, no contention
+static void BM_QueuePushPop(benchmark::State &state) {
+  AVQueue<int> queue(1024);
+  queue.open();
+  int x = 0;
+  for (auto _ : state) {
+    queue.push(x);
+    queue.pop(x);
+    benchmark::DoNotOptimize(x);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QueuePushPop);
+
+// a decoder thread feeding the render loop, the consumer polls like
+// onSDLVideoPlay() does
+static void BM_QueueProducerConsumer(benchmark::State &state) {
+  const int64_t batch = 10000;
+  for (auto _ : state) {
+    AVQueue<int> queue((size_t)state.range(0));
+    queue.open();
+    std::thread producer([&] {
+      for (int i = 0; i < batch; i++) queue.push(i);
+    });
+    int64_t received = 0;
+    int x;
+    while (received < batch) {
+      if (queue.pop(x))
+        received++;
+      else
+        std::this_thread::yield();
+    }
+    producer.join();
+    queue.close();
+  }
+  state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_QueueProducerConsumer)->Arg(16)->Arg(256)->UseRealTime();
+
+// decoded size to the window size, same format
+static void BM_ConvertScale(benchmark::State &state) {
+  int width = (int)state.range(0), height = (int)state.range(1);
+  AVFramePtr pIn = makeVideoFrame(1920, 1080, AV_PIX_FMT_YUV420P);
+  AVFramePtr pOut = makeVideoFrame(width, height, AV_PIX_FMT_YUV420P);
+  auto converter = Converter::create(1920, 1080, AV_PIX_FMT_YUV420P, width,
+                                     height, AV_PIX_FMT_YUV420P);
+  if (!converter) {
+    state.SkipWithError("no scaler");
+    return;
+  }
+  for (auto _ : state) {
+    converter->init(1920, 1080, AV_PIX_FMT_YUV420P, width, height,
+                    AV_PIX_FMT_YUV420P);
+    converter->convert(pIn, pOut);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() *
+                          av_image_get_buffer_size(AV_PIX_FMT_YUV420P, 1920,
+                                                   1080, 1));
+}
+BENCHMARK(BM_ConvertScale)->Args({1280, 720})->Args({640, 360});
+
+// same size, for a renderer without YUV textures
+static void BM_ConvertToRGB(benchmark::State &state) {
+  int width = (int)state.range(0), height = (int)state.range(1);
+  AVFramePtr pIn = makeVideoFrame(width, height, AV_PIX_FMT_YUV420P);
+  AVFramePtr pOut = makeVideoFrame(width, height, AV_PIX_FMT_RGB24);
+  auto converter = Converter::create(width, height, AV_PIX_FMT_YUV420P, width,
+                                     height, AV_PIX_FMT_RGB24);
+  if (!converter) {
+    state.SkipWithError("no scaler");
+    return;
+  }
+  for (auto _ : state) converter->convert(pIn, pOut);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ConvertToRGB)->Args({1280, 720})->Args({1920, 1080});
+
+// a 44.1kHz AAC frame to the usual device format
+static void BM_Resample(benchmark::State &state) {
+  AVFramePtr pIn = makeAudioFrame(1024, 44100, 2);
+  auto resampler = Resampler::create(2, AV_SAMPLE_FMT_FLTP, 44100, 2,
+                                     AV_SAMPLE_FMT_S16, 48000);
+  if (!resampler) {
+    state.SkipWithError("no resampler");
+    return;
+  }
+  for (auto _ : state) {
+    AVFramePtr pOut = makeAVFrame();
+    resampler->resample(pIn, pOut);
+    benchmark::DoNotOptimize(pOut->nb_samples);
+  }
+  state.SetItemsProcessed(state.iterations() * pIn->nb_samples);
+}
+BENCHMARK(BM_Resample);
+
+// the audio callback below full volume mixes instead of copying
+static void BM_Volume(benchmark::State &state) {
+  bool isMixed = state.range(0) != 0;
+  std::vector<Uint8> src(4096 * 4), dst(src.size());
+  for (size_t i = 0; i < src.size(); i++) src[i] = (Uint8)(i * 7);
+  for (auto _ : state) {
+    if (isMixed) {
+      std::memset(dst.data(), 0, dst.size());
+      SDL_MixAudioFormat(dst.data(), src.data(), AUDIO_S16SYS,
+                         (Uint32)src.size(), SDL_MIX_MAXVOLUME / 2);
+    } else {
+      std::memcpy(dst.data(), src.data(), src.size());
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * src.size());
+  state.SetLabel(isMixed ? "mix" : "memcpy");
+}
+BENCHMARK(BM_Volume)->Arg(0)->Arg(1);
+
+// CPU of the atempo chain per second of input audio, at the speeds
+// playback offers between 0.5x and 4x
+static void BM_AudioTempo(benchmark::State &state) {
+  double tempo = state.range(0) / 100.0;
+  AVFramePtr pIn = makeAudioFrame(1024, 48000, 2);
+  auto audioTempo = AudioTempo::create();
+  if (!audioTempo->init(pIn.get(), AVRational{1, 48000}, tempo)) {
+    state.SkipWithError("no atempo");
+    return;
+  }
+  int64_t outSamples = 0;
+  for (auto _ : state) {
+    audioTempo->send(pIn);
+    AVFramePtr pOut;
+    while (audioTempo->receive(pOut)) outSamples += pOut->nb_samples;
+  }
+  int64_t inSamples = state.iterations() * pIn->nb_samples;
+  state.SetItemsProcessed(inSamples);
+  state.counters["out_samples"] = (double)outSamples;
+  // the CPU time divided by the seconds of audio fed in
+  state.counters["cpu_s_per_audio_s"] = benchmark::Counter(
+      (double)inSamples / pIn->sample_rate,
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+BENCHMARK(BM_AudioTempo)
+    ->ArgName("tempo_pct")
+    ->Arg(50)
+    ->Arg(75)
+    ->Arg(125)
+    ->Arg(150)
+    ->Arg(200)
+    ->Arg(300)
+    ->Arg(400);
+
+// a LOG_* below the runtime level, what most calls in the pipeline cost
+static void BM_LogFiltered(benchmark::State &state) {
+  LogLevel level = Logger::level();
+  setBaseLogLevel(LWARN);
+  int64_t i = 0;
+  for (auto _ : state) {
+    LOG_INFO("[Bench] frame {} pts {}", i, 0.04 * i);
+    i++;
+  }
+  setBaseLogLevel(level);
+}
+BENCHMARK(BM_LogFiltered);
+
+// formatted and queued, the writer thread goes to /dev/null
+static void BM_LogEnabled(benchmark::State &state) {
+  LogLevel level = Logger::level();
+  setBaseLogLevel(LDEBUG);
+  std::fflush(stdout);
+  int saved = dup(STDOUT_FILENO);
+  int null = open("/dev/null", O_WRONLY);
+  dup2(null, STDOUT_FILENO);
+  int64_t i = 0;
+  for (auto _ : state) {
+    LOG_WARN("[Bench] frame {} pts {}", i, 0.04 * i);
+    i++;
+  }
+  Logger::instance().flush();
+  std::fflush(stdout);
+  dup2(saved, STDOUT_FILENO);
+  close(null);
+  close(saved);
+  setBaseLogLevel(level);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogEnabled)->UseRealTime();
+
+// below XPLAYER_LOG_MIN_LEVEL the call is gone at compile time
+static void BM_LogCompiledOut(benchmark::State &state) {
+  int64_t i = 0;
+  for (auto _ : state) {
+    LOG_DEBUG("[Bench] frame {}", i);
+    benchmark::DoNotOptimize(i++);
+  }
+  state.SetLabel(XPLAYER_LOG_MIN_LEVEL > LDEBUG ? "stripped" : "compiled in");
+}
+BENCHMARK(BM_LogCompiledOut);
@@ -0,0 +1,403 @@
+#include "MediaBench.h"
+
+#include <benchmark/benchmark.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SyntheticMedia.h"
+#include "xplayer/FFmpegUtil.h"
+#include "xplayer/Log.h"
+#include "xplayer/SDLPlayer.h"
+#include "xplayer/ThreadUsage.h"
+
+namespace {
+
+std::vector<ClipSpec> benchClips() {
+  std::vector<ClipSpec> clips;
+  auto add = [&](std::string name, int width, int height,
+                 std::string videoCodec, int gop) {
+    ClipSpec spec;
+    spec.name = std::move(name);
+    spec.width = width;
+    spec.height = height;
+    spec.video_codec = std::move(videoCodec);
+    spec.gop = gop;
+    clips.push_back(spec);
+  };
+  add("mpeg4_240p", 320, 240, "mpeg4", 30);
+  add("mpeg4_720p", 1280, 720, "mpeg4", 30);
+  add("mpeg4_1080p", 1920, 1080, "mpeg4", 30);
+  add("h264_720p", 1280, 720, "libx264", 60);  // skipped without libx264
+  add("mjpeg_720p", 1280, 720, "mjpeg", 1);
+  return clips;
+}
+
+// av_read_frame() over the whole file, the read thread without decoding
+void demuxBench(benchmark::State &state, const std::string &path) {
+  int64_t bytes = 0, packets = 0;
+  AVPacketPtr pPacket = makeAVPacket();
+  for (auto _ : state) {
+    AVFormatContext *ic = nullptr;
+    if (avformat_open_input(&ic, path.c_str(), nullptr, nullptr) < 0) {
+      state.SkipWithError("could not open the clip");
+      return;
+    }
+    while (av_read_frame(ic, pPacket.get()) >= 0) {
+      bytes += pPacket->size;
+      packets++;
+      av_packet_unref(pPacket.get());
+    }
+    avformat_close_input(&ic);
+  }
+  state.SetBytesProcessed(bytes);
+  state.SetItemsProcessed(packets);
+}
+
+// one video, three audio and two subtitle tracks: what the player skips
+// in the demuxer when it plays one track of each type
+ClipSpec multiTrackClip() {
+  ClipSpec spec;
+  spec.name = "tracks_mkv";
+  spec.width = 640;
+  spec.height = 360;
+  spec.audio_tracks = 3;
+  spec.subtitle_tracks = 2;
+  return spec;
+}
+
+// av_read_frame() after the probe, with every stream or only the best
+// audio and video ones selected as openUrl() does
+void demuxTracksBench(benchmark::State &state, const std::string &path,
+                      bool withDiscard) {
+  int64_t packets = 0, payloadBytes = 0, ioBytes = 0, cpuUS = 0;
+  AVPacketPtr pPacket = makeAVPacket();
+  for (auto _ : state) {
+    state.PauseTiming();
+    AVFormatContext *ic = nullptr;
+    if (avformat_open_input(&ic, path.c_str(), nullptr, nullptr) < 0 ||
+        avformat_find_stream_info(ic, nullptr) < 0) {
+      avformat_close_input(&ic);
+      state.SkipWithError("could not open the clip");
+      return;
+    }
+    if (withDiscard) {
+      int audio =
+          av_find_best_stream(ic, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+      int video =
+          av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+      for (unsigned int i = 0; i < ic->nb_streams; i++) {
+        if ((int)i != audio && (int)i != video)
+          ic->streams[i]->discard = AVDISCARD_ALL;
+      }
+    }
+    int64_t startPos = avio_tell(ic->pb);
+    ThreadUsage startUsage = ThreadUsage::self();
+    state.ResumeTiming();
+
+    while (av_read_frame(ic, pPacket.get()) >= 0) {
+      payloadBytes += pPacket->size;
+      packets++;
+      av_packet_unref(pPacket.get());
+    }
+
+    state.PauseTiming();
+    cpuUS += (ThreadUsage::self() - startUsage).cpu_us;
+    ioBytes += avio_tell(ic->pb) - startPos;
+    avformat_close_input(&ic);
+    state.ResumeTiming();
+  }
+
+  using benchmark::Counter;
+  // per pass over the file
+  auto perRun = [](double value) {
+    return Counter(value, Counter::kAvgIterations);
+  };
+  state.counters["demux_cpu_ms"] = perRun(cpuUS / 1000.0);
+  state.counters["io_bytes"] = perRun((double)ioBytes);
+  state.counters["payload_bytes"] = perRun((double)payloadBytes);
+  state.counters["packets"] = perRun((double)packets);
+}
+
+// the whole pipeline on the headless sinks, unpaced: what a release can
+// decode, convert and output per second
+void playbackBench(benchmark::State &state, const std::string &path) {
+  PlayerConfig config;
+  config.video.width = -1;
+  config.video.height = -1;
+  config.video.format = AV_PIX_FMT_YUV420P;
+  config.common.unpaced = true;
+  config.common.keyframe_index = false;  // no index files in the cache
+  config.play_after_ready = false;
+  auto player = SDLPlayer::create(config);
+  if (!player) {
+    state.SkipWithError("could not create the player");
+    return;
+  }
+
+  SDLPlayer::Stats total;
+  for (auto _ : state) {
+    player->init(config);
+    if (!player->openUrl(path)) {
+      state.SkipWithError(player->lastError().c_str());
+      return;
+    }
+    player->play();  // renders on this thread until the media ends
+    player->close();
+    SDLPlayer::Stats stats = player->lastStats();
+    total.frames += stats.frames;
+    total.audio_samples += stats.audio_samples;
+    total.elapsed_us += stats.elapsed_us;
+    for (int i = 0; i < SDLPlayer::THREAD_COUNT; i++)
+      total.threads[i].cpu_us += stats.threads[i].cpu_us;
+  }
+  player->destroy();
+
+  using benchmark::Counter;
+  state.counters["fps"] = total.fps();
+  state.counters["audio_samples_per_s"] = total.audioSamplesPerSecond();
+  state.counters["frames"] = Counter((double)total.frames, Counter::kAvgIterations);
+  // milliseconds of CPU per run
+  auto cpu = [&](int64_t us) {
+    return Counter(us / 1000.0, Counter::kAvgIterations);
+  };
+  state.counters["read_cpu_ms"] =
+      cpu(total.threads[SDLPlayer::THREAD_READ].cpu_us);
+  state.counters["video_decode_cpu_ms"] =
+      cpu(total.threads[SDLPlayer::THREAD_VIDEO_DECODE].cpu_us);
+  state.counters["audio_decode_cpu_ms"] =
+      cpu(total.threads[SDLPlayer::THREAD_AUDIO_DECODE].cpu_us);
+  state.counters["render_cpu_ms"] =
+      cpu(total.threads[SDLPlayer::THREAD_RENDER].cpu_us);
+}
+
+// a matroska index, MPEG-TS without one and a raw stream the demuxer can
+// only seek in by bytes
+std::vector<ClipSpec> seekClips() {
+  std::vector<ClipSpec> clips;
+  auto add = [&](std::string name, std::string container,
+                 std::string extension, bool hasAudio) {
+    ClipSpec spec;
+    spec.name = std::move(name);
+    spec.container = std::move(container);
+    spec.extension = std::move(extension);
+    if (!hasAudio) spec.audio_codec.clear();
+    clips.push_back(spec);
+  };
+  add("seek_mkv", "matroska", "mkv", true);
+  add("seek_ts", "mpegts", "ts", true);
+  add("seek_m4v", "m4v", "m4v", false);
+  return clips;
+}
+
+// short items of one codec and another, for the open cost between them
+std::vector<ClipSpec> playlistClips() {
+  std::vector<ClipSpec> clips;
+  auto add = [&](std::string name, std::string videoCodec, int gop) {
+    ClipSpec spec;
+    spec.name = std::move(name);
+    spec.seconds = 2;
+    spec.video_codec = std::move(videoCodec);
+    spec.gop = gop;
+    clips.push_back(spec);
+  };
+  add("playlist_mpeg4_a", "mpeg4", 30);
+  add("playlist_mpeg4_b", "mpeg4", 30);
+  add("playlist_mjpeg", "mjpeg", 1);
+  return clips;
+}
+
+// opens and closes the items in turn, timing each openUrl(). The decoder
+// cache reuses the contexts when consecutive items share the codec.
+void playlistOpenBench(benchmark::State &state,
+                       const std::vector<std::string> &items) {
+  PlayerConfig config;
+  config.video.width = -1;
+  config.video.height = -1;
+  config.common.keyframe_index = false;
+  config.output.headless = true;
+  config.play_after_ready = false;
+  auto player = SDLPlayer::create(config);
+  if (!player) {
+    state.SkipWithError("could not create the player");
+    return;
+  }
+
+  int64_t opens = 0, reused = 0, decoderUS = 0;
+  for (auto _ : state) {
+    player->init(config);
+    const std::string &item = items[opens % items.size()];
+    if (!player->openUrl(item)) {
+      state.SkipWithError(player->lastError().c_str());
+      break;
+    }
+    state.SetIterationTime(player->lastOpenTime() / 1e6);
+    // the first item always opens its decoders
+    if (opens > 0) {
+      reused += player->videoDecoder()->isReused();
+      decoderUS += player->videoDecoder()->lastOpenTime() +
+                   player->audioDecoder()->lastOpenTime();
+    }
+    opens++;
+    player->close();
+  }
+  player->destroy();
+
+  if (opens > 1) {
+    state.counters["decoder_reuse"] = (double)reused / (opens - 1);
+    state.counters["decoder_open_us"] = (double)decoderUS / (opens - 1);
+  }
+}
+
+bool waitFor(const std::function<bool()> &done, int timeoutMS) {
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMS);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > deadline) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+// paused seeks over the whole clip, from the request to the first frame
+// displayed. With the index it is scanned before the first seek.
+void seekBench(benchmark::State &state, const std::string &path,
+               bool withIndex) {
+  PlayerConfig config;
+  config.video.width = -1;
+  config.video.height = -1;
+  config.video.format = AV_PIX_FMT_YUV420P;
+  config.video.frame_cache_mb = 0;  // every seek goes to the demuxer
+  config.common.keyframe_index = withIndex;
+  config.common.keyframe_index_scan = withIndex;
+  config.output.headless = true;
+  config.play_after_ready = false;
+  auto player = SDLPlayer::create(config);
+  if (!player) {
+    state.SkipWithError("could not create the player");
+    return;
+  }
+  player->init(config);
+  if (!player->openUrl(path)) {
+    state.SkipWithError(player->lastError().c_str());
+    return;
+  }
+  // renders on its own thread, the seeks come from this one
+  std::thread renderThread([&] { player->play(); });
+  int64_t totalMS = player->getTotalTime();
+  bool isReady =
+      totalMS > 1000 &&
+      waitFor([&] { return !std::isnan(player->videoClock()); }, 5000) &&
+      player->pause() &&
+      (!withIndex ||
+       waitFor([&] { return player->keyframeIndex()->isComplete(); }, 10000));
+
+  int64_t seeks = 0, demuxUS = 0;
+  for (auto _ : state) {
+    if (!isReady) {
+      state.SkipWithError("the player didn't start");
+      break;
+    }
+    // spread over the clip, never twice in a row the same GOP
+    int64_t target = (seeks * 3637) % (totalMS - 1000) + 500;
+    player->seek(target);
+    if (!waitFor([&] { return !player->isSeeking(); }, 5000)) {
+      state.SkipWithError("a seek timed out");
+      break;
+    }
+    state.SetIterationTime(player->lastSeekDisplayTime() / 1e6);
+    demuxUS += player->lastSeekTime();
+    seeks++;
+  }
+  // played to the end, the render loop closes the media
+  player->seek(FFMAX(totalMS - 200, 0));
+  player->replay();
+  renderThread.join();
+  state.counters["indexed_keyframes"] =
+      (double)player->keyframeIndex()->size();
+  player->destroy();
+
+  if (seeks > 0)
+    state.counters["demux_seek_ms"] = demuxUS / 1000.0 / seeks;
+}
+
+}  // namespace
+
+void registerMediaBenchmarks() {
+  // keyframe indexes are kept with the clips, not in the user's cache
+  setenv("XDG_CACHE_HOME", syntheticMediaDir().c_str(), 1);
+
+  for (const ClipSpec &spec : benchClips()) {
+    std::string path = syntheticClip(spec);
+    if (path.empty()) {
+      LOG_WARN("[Bench] No {} clip, its benchmarks are skipped", spec.name);
+      continue;
+    }
+    benchmark::RegisterBenchmark(("BM_Demux/" + spec.name).c_str(), demuxBench,
+                                 path)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("BM_Playback/" + spec.name).c_str(),
+                                 playbackBench, path)
+        ->Iterations(3)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+  }
+  std::string tracksPath = syntheticClip(multiTrackClip());
+  if (tracksPath.empty()) {
+    LOG_WARN("[Bench] No multi-track clip, BM_DemuxTracks is skipped");
+  }
+  else {
+    for (bool withDiscard : {false, true})
+      benchmark::RegisterBenchmark(
+          withDiscard ? "BM_DemuxTracks/selected" : "BM_DemuxTracks/all",
+          demuxTracksBench, tracksPath, withDiscard)
+          ->Unit(benchmark::kMillisecond);
+  }
+  std::vector<std::string> playlist;
+  for (const ClipSpec &spec : playlistClips()) {
+    std::string path = syntheticClip(spec);
+    if (path.empty()) {
+      LOG_WARN("[Bench] No {} clip, the playlist benchmarks are skipped",
+               spec.name);
+      playlist.clear();
+      break;
+    }
+    playlist.push_back(path);
+  }
+  if (playlist.size() == 3) {
+    // decoder cache hits, then a miss on every item
+    std::vector<std::string> sameCodec = {playlist[0], playlist[1]};
+    std::vector<std::string> codecChange = {playlist[0], playlist[2]};
+    benchmark::RegisterBenchmark("BM_PlaylistOpen/same_codec",
+                                 playlistOpenBench, sameCodec)
+        ->Iterations(20)
+        ->Unit(benchmark::kMillisecond)
+        ->UseManualTime();
+    benchmark::RegisterBenchmark("BM_PlaylistOpen/codec_change",
+                                 playlistOpenBench, codecChange)
+        ->Iterations(20)
+        ->Unit(benchmark::kMillisecond)
+        ->UseManualTime();
+  }
+
+  for (const ClipSpec &spec : seekClips()) {
+    std::string path = syntheticClip(spec);
+    if (path.empty()) {
+      LOG_WARN("[Bench] No {} clip, its benchmarks are skipped", spec.name);
+      continue;
+    }
+    for (bool withIndex : {false, true})
+      benchmark::RegisterBenchmark(
+          ("BM_Seek/" + spec.name + (withIndex ? "/index" : "/no_index"))
+              .c_str(),
+          seekBench, path, withIndex)
+          ->Iterations(20)
+          ->Unit(benchmark::kMillisecond)
+          ->UseManualTime();
+  }
+}
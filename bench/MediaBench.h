@@ -0,0 +1,5 @@
+#pragma once
+
+// encodes the synthetic clips on first use and registers the benchmarks
+// that need media files, one per clip
+void registerMediaBenchmarks();
@@ -0,0 +1,324 @@
+// Playback quality rather than speed: a clip flashing white and beeping at
+// every whole second plays in real time through the real scheduling code
+// on the headless sinks, which timestamp what they are given.
+
+#include "SyncBench.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "SyntheticMedia.h"
+#include "xplayer/FFmpegUtil.h"
+#include "xplayer/Log.h"
+#include "xplayer/Mutex.h"
+#include "xplayer/SDLPlayer.h"
+
+namespace {
+
+std::atomic_bool gate_failed{false};
+
+constexpr int kFps = 30;
+constexpr int kSeconds = 6;
+
+// what a release must hold, a run outside them fails the gate
+struct SyncThresholds
+{
+  // ITU-R BT.1359 detectability: audio 45ms early to 125ms late
+  double max_audio_lead_ms = 45.0;
+  double max_audio_lag_ms = 125.0;
+  double max_jitter_ms = 4.0;  // standard deviation of the frame intervals
+  double max_drop_ratio = 0.01;
+  double max_dup_ratio = 0.01;
+  double max_startup_ms = 500.0;  // openUrl() to the first frame and beep
+};
+
+struct SyncReport
+{
+  int64_t frames = 0;
+  int64_t dups = 0;  // the same pts presented again
+  int64_t drops = 0;  // pts skipped between two presented frames
+  double jitter_ms = 0.0;
+  double jitter_max_ms = 0.0;
+  // audio minus video of every flash matched to a beep, in order
+  std::vector<double> offsets_ms;
+  double video_startup_ms = NAN;
+  double audio_startup_ms = NAN;
+
+  double offsetMean() const {
+    double sum = 0.0;
+    for (double offset : offsets_ms) sum += offset;
+    return offsets_ms.empty() ? NAN : sum / offsets_ms.size();
+  }
+  double offsetMin() const {
+    return offsets_ms.empty()
+               ? NAN
+               : *std::min_element(offsets_ms.begin(), offsets_ms.end());
+  }
+  double offsetMax() const {
+    return offsets_ms.empty()
+               ? NAN
+               : *std::max_element(offsets_ms.begin(), offsets_ms.end());
+  }
+  double offsetDrift() const {
+    return offsets_ms.size() < 2 ? 0.0
+                                 : offsets_ms.back() - offsets_ms.front();
+  }
+};
+
+// Collects the presented frames and the beep onsets from the sink taps
+class SyncProbe {
+public:
+  void onPresent(const AVFrame *frame, int64_t timeUS) {
+    bool isFlash = meanLuma(frame) > 128;
+    Mutex::lock locker(mutex_);
+    presents_.push_back({timeUS, frame->pts, isFlash});
+  }
+
+  void onAudio(const Uint8 *data, int len, int64_t position, int64_t timeUS,
+               const SDL_AudioSpec &spec) {
+    int sampleBytes = SDL_AUDIO_BITSIZE(spec.format) / 8;
+    int frameBytes = sampleBytes * spec.channels;
+    if (frameBytes <= 0 || spec.freq <= 0) return;
+    // a device starts playing the buffer after the one it is playing
+    int64_t startUS = timeUS + (int64_t)spec.samples * 1000000 / spec.freq;
+    for (int i = 0; i < len / frameBytes; i++) {
+      const Uint8 *sample = data + (ptrdiff_t)i * frameBytes;
+      float level = SDL_AUDIO_ISFLOAT(spec.format)
+                        ? std::fabs(*reinterpret_cast<const float *>(sample))
+                        : std::abs(*reinterpret_cast<const int16_t *>(sample)) /
+                              32768.0f;
+      if (level < 0.25f) continue;
+      // a beep is 50ms of tone after at least half a second of silence
+      if (position + i - last_loud_sample_ > spec.freq / 2) {
+        Mutex::lock locker(mutex_);
+        beeps_.push_back(startUS + (int64_t)i * 1000000 / spec.freq);
+      }
+      last_loud_sample_ = position + i;
+    }
+  }
+
+  SyncReport report(int64_t startUS) const {
+    Mutex::lock locker(mutex_);
+    SyncReport report;
+    report.frames = (int64_t)presents_.size();
+    if (!presents_.empty())
+      report.video_startup_ms = (presents_.front().time_us - startUS) / 1000.0;
+    if (!beeps_.empty())
+      report.audio_startup_ms = (beeps_.front() - startUS) / 1000.0;
+
+    // the wall clock intervals against the pts intervals
+    const double frameUS = 1e6 / kFps;
+    double sum = 0.0, sumSquares = 0.0;
+    int64_t intervals = 0;
+    for (size_t i = 1; i < presents_.size(); i++) {
+      const Present &prev = presents_[i - 1], &cur = presents_[i];
+      if (cur.pts_us == AV_NOPTS_VALUE || prev.pts_us == AV_NOPTS_VALUE)
+        continue;
+      int64_t ptsDelta = cur.pts_us - prev.pts_us;
+      if (ptsDelta == 0) {
+        report.dups++;
+        continue;
+      }
+      if (ptsDelta > 1.5 * frameUS)
+        report.drops += std::llround(ptsDelta / frameUS) - 1;
+      double error = (cur.time_us - prev.time_us - ptsDelta) / 1000.0;
+      sum += error;
+      sumSquares += error * error;
+      report.jitter_max_ms = std::max(report.jitter_max_ms, std::fabs(error));
+      intervals++;
+    }
+    if (intervals > 0) {
+      double mean = sum / intervals;
+      report.jitter_ms =
+          std::sqrt(std::max(0.0, sumSquares / intervals - mean * mean));
+    }
+
+    // flashes and beeps are a second apart, the nearest beep is the match
+    for (size_t i = 0; i < presents_.size(); i++) {
+      if (!presents_[i].is_flash || (i > 0 && presents_[i - 1].is_flash))
+        continue;
+      int64_t flashUS = presents_[i].time_us;
+      auto nearest = std::min_element(
+          beeps_.begin(), beeps_.end(), [&](int64_t a, int64_t b) {
+            return std::llabs(a - flashUS) < std::llabs(b - flashUS);
+          });
+      if (nearest != beeps_.end() && std::llabs(*nearest - flashUS) < 500000)
+        report.offsets_ms.push_back((*nearest - flashUS) / 1000.0);
+    }
+    return report;
+  }
+
+private:
+  struct Present
+  {
+    int64_t time_us;
+    int64_t pts_us;
+    bool is_flash;
+  };
+
+  // of the first plane, every 16th pixel of every 16th row
+  static int meanLuma(const AVFrame *frame) {
+    if (!frame->data[0] || frame->width <= 0 || frame->height <= 0) return 0;
+    int64_t sum = 0, count = 0;
+    for (int y = 0; y < frame->height; y += 16)
+      for (int x = 0; x < frame->width; x += 16) {
+        sum += frame->data[0][(ptrdiff_t)y * frame->linesize[0] + x];
+        count++;
+      }
+    return (int)(sum / count);
+  }
+
+private:
+  mutable Mutex::type mutex_;
+  std::vector<Present> presents_;
+  std::vector<int64_t> beeps_;
+  int64_t last_loud_sample_{INT64_MIN / 2};  // sink thread only
+};
+
+std::string syncClip() {
+  ClipSpec spec;
+  spec.name = "sync_360p";
+  spec.width = 640;
+  spec.height = 360;
+  spec.fps = kFps;
+  spec.seconds = kSeconds;
+  spec.gop = kFps;
+  // one white frame and 50ms of 1kHz at every whole second
+  spec.video_source = fmt::format(
+      "color=c=black:size={}x{}:rate={}:duration={},"
+      "drawbox=x=0:y=0:w=iw:h=ih:color=white:t=fill:"
+      "enable='lt(mod(t,1),{})'",
+      spec.width, spec.height, kFps, kSeconds, 1.0 / kFps);
+  spec.audio_source = fmt::format(
+      "aevalsrc=exprs='if(lt(mod(t,1),0.05),0.8*sin(2*PI*1000*t),0)':"
+      "sample_rate={}:duration={}",
+      spec.sample_rate, kSeconds);
+  return syntheticClip(spec);
+}
+
+std::vector<std::string> checkThresholds(const SyncReport &report,
+                                         const SyncThresholds &limits) {
+  std::vector<std::string> failures;
+  if (report.offsets_ms.empty()) {
+    failures.push_back("no flash matched a beep");
+  } else {
+    if (report.offsetMin() < -limits.max_audio_lead_ms)
+      failures.push_back(
+          fmt::format("audio {:.1f}ms early", -report.offsetMin()));
+    if (report.offsetMax() > limits.max_audio_lag_ms)
+      failures.push_back(fmt::format("audio {:.1f}ms late", report.offsetMax()));
+  }
+  if (report.jitter_ms > limits.max_jitter_ms)
+    failures.push_back(fmt::format("jitter {:.2f}ms", report.jitter_ms));
+  double expected = (double)kFps * kSeconds;
+  if (report.drops > limits.max_drop_ratio * expected)
+    failures.push_back(fmt::format("{} frames dropped", report.drops));
+  if (report.dups > limits.max_dup_ratio * expected)
+    failures.push_back(fmt::format("{} frames repeated", report.dups));
+  if (!(report.video_startup_ms <= limits.max_startup_ms))
+    failures.push_back(
+        fmt::format("first frame after {:.0f}ms", report.video_startup_ms));
+  if (!(report.audio_startup_ms <= limits.max_startup_ms))
+    failures.push_back(
+        fmt::format("first beep after {:.0f}ms", report.audio_startup_ms));
+  return failures;
+}
+
+}  // namespace
+
+bool syncGateFailed() { return gate_failed; }
+
+static void BM_AVSync(benchmark::State &state) {
+  auto syncMode = (PlayerConfig::SyncMode)state.range(0);
+  std::string path = syncClip();
+  if (path.empty()) {
+    state.SkipWithError("could not encode the sync clip");
+    return;
+  }
+
+  PlayerConfig config;
+  config.video.width = -1;
+  config.video.height = -1;
+  config.video.format = AV_PIX_FMT_YUV420P;
+  config.audio.format = AV_SAMPLE_FMT_S16;
+  config.common.sync_mode = syncMode;
+  config.common.keyframe_index = false;
+  config.output.headless = true;
+  config.play_after_ready = false;
+  auto player = SDLPlayer::create(config);
+  if (!player) {
+    state.SkipWithError("could not create the player");
+    return;
+  }
+
+  SyncReport report;
+  for (auto _ : state) {
+    SyncProbe probe;
+    auto videoSink = NullVideoSink::create(false);
+    auto audioSink = HeadlessAudioSink::create("", true);
+    videoSink->setPresentTap([&](const AVFrame *frame, int64_t timeUS) {
+      probe.onPresent(frame, timeUS);
+    });
+    audioSink->setBufferTap(
+        [&, sink = audioSink.get()](const Uint8 *data, int len,
+                                    int64_t position, int64_t timeUS) {
+          probe.onAudio(data, len, position, timeUS, sink->audioSpec());
+        });
+    player->init(config);
+    player->setSinks(videoSink, audioSink);
+
+    int64_t startUS = av_gettime_relative();
+    if (!player->openUrl(path)) {
+      state.SkipWithError(player->lastError().c_str());
+      return;
+    }
+    player->play();  // renders on this thread until the media ends
+    player->close();
+    player->destroy();
+    report = probe.report(startUS);
+  }
+
+  state.counters["frames"] = (double)report.frames;
+  state.counters["dups"] = (double)report.dups;
+  state.counters["drops"] = (double)report.drops;
+  state.counters["jitter_ms"] = report.jitter_ms;
+  state.counters["jitter_max_ms"] = report.jitter_max_ms;
+  state.counters["av_offset_mean_ms"] = report.offsetMean();
+  state.counters["av_offset_min_ms"] = report.offsetMin();
+  state.counters["av_offset_max_ms"] = report.offsetMax();
+  state.counters["av_offset_drift_ms"] = report.offsetDrift();
+  state.counters["video_startup_ms"] = report.video_startup_ms;
+  state.counters["audio_startup_ms"] = report.audio_startup_ms;
+
+  // the offset at every second, positive when the audio is late
+  std::string offsets = "offsets_ms:";
+  for (double offset : report.offsets_ms)
+    offsets += fmt::format(" {:.1f}", offset);
+  state.SetLabel(offsets);
+
+  std::vector<std::string> failures =
+      checkThresholds(report, SyncThresholds{});
+  state.counters["gate_passed"] = failures.empty() ? 1 : 0;
+  if (!failures.empty()) {
+    gate_failed = true;
+    std::string reasons;
+    for (const std::string &failure : failures)
+      reasons += (reasons.empty() ? "" : ", ") + failure;
+    LOG_ERROR("[Bench] A/V sync gate failed with sync mode {}: {}",
+              (int)syncMode, reasons);
+  }
+}
+BENCHMARK(BM_AVSync)
+    ->ArgName("sync_mode")
+    ->Arg(PlayerConfig::AUDIO_MASTER)
+    ->Arg(PlayerConfig::VIDEO_MASTER)
+    ->Arg(PlayerConfig::EXTERNAL_MASTER)
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,305 @@
+#include "SyntheticMedia.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <vector>
+
+extern "C" {
+#include <libavfilter/buffersink.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "xplayer/FFmpegUtil.h"
+#include "xplayer/Log.h"
+
+namespace {
+
+// one lavfi graph feeding one encoder and one output stream
+struct Track
+{
+  AVFilterGraph *graph = nullptr;
+  AVFilterContext *sink = nullptr;
+  AVCodecContext *codec = nullptr;
+  AVStream *stream = nullptr;
+  int64_t next_pts = 0;  // codec time base
+  bool is_done = false;
+
+  ~Track() {
+    avfilter_graph_free(&graph);
+    avcodec_free_context(&codec);
+  }
+  bool isActive() const { return codec && !is_done; }
+};
+
+// text packets written as they come due, no encoder involved
+struct Subtitles
+{
+  AVStream *stream = nullptr;
+  int64_t next_ms = 0;
+};
+
+bool buildGraph(Track &track, const std::string &desc, bool isVideo) {
+  track.graph = avfilter_graph_alloc();
+  if (!track.graph) return false;
+  const AVFilter *sink =
+      avfilter_get_by_name(isVideo ? "buffersink" : "abuffersink");
+  if (avfilter_graph_create_filter(&track.sink, sink, "out", nullptr, nullptr,
+                                   track.graph) < 0)
+    return false;
+
+  // the unlabeled output of the description links to "out"
+  AVFilterInOut *inputs = avfilter_inout_alloc();
+  AVFilterInOut *outputs = nullptr;
+  inputs->name = av_strdup("out");
+  inputs->filter_ctx = track.sink;
+  inputs->pad_idx = 0;
+  inputs->next = nullptr;
+  int ret = avfilter_graph_parse_ptr(track.graph, desc.c_str(), &inputs,
+                                     &outputs, nullptr);
+  avfilter_inout_free(&inputs);
+  avfilter_inout_free(&outputs);
+  if (ret < 0 || avfilter_graph_config(track.graph, nullptr) < 0) {
+    LOG_ERROR("[SyntheticMedia] Invalid filter graph: {}", desc);
+    return false;
+  }
+  return true;
+}
+
+bool addStream(Track &track, AVFormatContext *oc) {
+  if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+    track.codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  if (avcodec_open2(track.codec, track.codec->codec, nullptr) < 0) {
+    LOG_ERROR("[SyntheticMedia] Could not open the {} encoder",
+              track.codec->codec->name);
+    return false;
+  }
+  track.stream = avformat_new_stream(oc, nullptr);
+  if (!track.stream) return false;
+  track.stream->time_base = track.codec->time_base;
+  return avcodec_parameters_from_context(track.stream->codecpar,
+                                         track.codec) >= 0;
+}
+
+bool openVideo(const ClipSpec &spec, AVFormatContext *oc, Track &track) {
+  const AVCodec *encoder = avcodec_find_encoder_by_name(spec.video_codec.c_str());
+  if (!encoder) {
+    LOG_WARN("[SyntheticMedia] No {} encoder", spec.video_codec);
+    return false;
+  }
+  track.codec = avcodec_alloc_context3(encoder);
+  if (!track.codec) return false;
+  track.codec->width = spec.width;
+  track.codec->height = spec.height;
+  track.codec->time_base = AVRational{1, spec.fps};
+  track.codec->framerate = AVRational{spec.fps, 1};
+  track.codec->gop_size = spec.gop;
+  track.codec->pix_fmt =
+      encoder->pix_fmts ? encoder->pix_fmts[0] : AV_PIX_FMT_YUV420P;
+  // ~0.12 bits per pixel, close to what streaming sites deliver
+  track.codec->bit_rate = (int64_t)spec.width * spec.height * spec.fps / 8;
+  if (!addStream(track, oc)) return false;
+
+  std::string source =
+      !spec.video_source.empty()
+          ? spec.video_source
+          : fmt::format("testsrc=size={}x{}:rate={}:duration={}", spec.width,
+                        spec.height, spec.fps, spec.seconds);
+  return buildGraph(track,
+                    fmt::format("{},format={}", source,
+                                av_get_pix_fmt_name(track.codec->pix_fmt)),
+                    true);
+}
+
+bool openAudio(const ClipSpec &spec, int index, AVFormatContext *oc,
+               Track &track) {
+  const AVCodec *encoder = avcodec_find_encoder_by_name(spec.audio_codec.c_str());
+  if (!encoder) {
+    LOG_WARN("[SyntheticMedia] No {} encoder", spec.audio_codec);
+    return false;
+  }
+  track.codec = avcodec_alloc_context3(encoder);
+  if (!track.codec) return false;
+  track.codec->sample_rate = spec.sample_rate;
+  track.codec->channels = spec.channels;
+  track.codec->channel_layout = av_get_default_channel_layout(spec.channels);
+  track.codec->sample_fmt =
+      encoder->sample_fmts ? encoder->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+  track.codec->time_base = AVRational{1, spec.sample_rate};
+  track.codec->bit_rate = 64000 * spec.channels;
+  if (!addStream(track, oc)) return false;
+
+  char layout[64];
+  av_get_channel_layout_string(layout, sizeof(layout), spec.channels,
+                               track.codec->channel_layout);
+  std::string source =
+      !spec.audio_source.empty()
+          ? spec.audio_source
+          : fmt::format("sine=frequency={}:sample_rate={}:duration={}",
+                        1000 << index, spec.sample_rate, spec.seconds);
+  if (!buildGraph(
+          track,
+          fmt::format("{},aformat=sample_fmts={}:sample_rates={}:"
+                      "channel_layouts={}",
+                      source, av_get_sample_fmt_name(track.codec->sample_fmt),
+                      spec.sample_rate, layout),
+          false))
+    return false;
+  // most encoders take fixed size frames
+  if (!(encoder->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE) &&
+      track.codec->frame_size > 0)
+    av_buffersink_set_frame_size(track.sink, track.codec->frame_size);
+  return true;
+}
+
+bool openSubtitles(AVFormatContext *oc, Subtitles &track) {
+  track.stream = avformat_new_stream(oc, nullptr);
+  if (!track.stream) return false;
+  track.stream->codecpar->codec_type = AVMEDIA_TYPE_SUBTITLE;
+  track.stream->codecpar->codec_id = AV_CODEC_ID_SUBRIP;
+  track.stream->time_base = AVRational{1, 1000};
+  return true;
+}
+
+// the lines due up to `until`, milliseconds
+bool writeSubtitles(const ClipSpec &spec, Subtitles &track,
+                    AVFormatContext *oc, int64_t until) {
+  until = FFMIN(until, (int64_t)spec.seconds * 1000);
+  while (track.next_ms < until) {
+    std::string text = fmt::format("Line {}", track.next_ms / 1000 + 1);
+    AVPacketPtr pPacket = makeAVPacket();
+    if (av_new_packet(pPacket.get(), (int)text.size()) < 0) return false;
+    memcpy(pPacket->data, text.data(), text.size());
+    pPacket->pts = pPacket->dts = av_rescale_q(
+        track.next_ms, AVRational{1, 1000}, track.stream->time_base);
+    pPacket->duration =
+        av_rescale_q(1000, AVRational{1, 1000}, track.stream->time_base);
+    pPacket->flags |= AV_PKT_FLAG_KEY;
+    pPacket->stream_index = track.stream->index;
+    if (av_interleaved_write_frame(oc, pPacket.get()) < 0) return false;
+    track.next_ms += 1000;
+  }
+  return true;
+}
+
+bool encode(Track &track, AVFormatContext *oc, const AVFrame *frame) {
+  if (avcodec_send_frame(track.codec, frame) < 0) return false;
+  AVPacketPtr pPacket = makeAVPacket();
+  while (true) {
+    int ret = avcodec_receive_packet(track.codec, pPacket.get());
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) return true;
+    if (ret < 0) return false;
+    av_packet_rescale_ts(pPacket.get(), track.codec->time_base,
+                         track.stream->time_base);
+    pPacket->stream_index = track.stream->index;
+    if (av_interleaved_write_frame(oc, pPacket.get()) < 0) return false;
+  }
+}
+
+// moves one frame from the graph through the encoder, the encoder is
+// drained at the end of the source
+bool pull(Track &track, AVFormatContext *oc) {
+  AVFramePtr pFrame = makeAVFrame();
+  int ret = av_buffersink_get_frame(track.sink, pFrame.get());
+  if (ret == AVERROR_EOF) {
+    track.is_done = true;
+    return encode(track, oc, nullptr);
+  }
+  if (ret < 0) return false;
+  pFrame->pts = av_rescale_q(pFrame->pts,
+                             av_buffersink_get_time_base(track.sink),
+                             track.codec->time_base);
+  pFrame->pict_type = AV_PICTURE_TYPE_NONE;
+  track.next_pts = pFrame->pts;
+  return encode(track, oc, pFrame.get());
+}
+
+bool encodeClip(const ClipSpec &spec, const std::string &path) {
+  AVFormatContext *oc = nullptr;
+  if (avformat_alloc_output_context2(&oc, nullptr, spec.container.c_str(),
+                                     path.c_str()) < 0) {
+    LOG_ERROR("[SyntheticMedia] No {} muxer", spec.container);
+    return false;
+  }
+  std::shared_ptr<AVFormatContext> output(oc, [](AVFormatContext *oc) {
+    if (oc->pb) avio_closep(&oc->pb);
+    avformat_free_context(oc);
+  });
+
+  // a deque never moves the tracks it holds
+  std::deque<Track> tracks;
+  if (!spec.video_codec.empty() &&
+      !openVideo(spec, oc, tracks.emplace_back()))
+    return false;
+  for (int i = 0; !spec.audio_codec.empty() && i < spec.audio_tracks; i++) {
+    if (!openAudio(spec, i, oc, tracks.emplace_back())) return false;
+  }
+  std::vector<Subtitles> subtitles(FFMAX(spec.subtitle_tracks, 0));
+  for (Subtitles &track : subtitles) {
+    if (!openSubtitles(oc, track)) return false;
+  }
+  if (avio_open(&oc->pb, path.c_str(), AVIO_FLAG_WRITE) < 0 ||
+      avformat_write_header(oc, nullptr) < 0) {
+    LOG_ERROR("[SyntheticMedia] Could not write {}", path);
+    return false;
+  }
+
+  // interleaved by timestamp, as a demuxer would read them back
+  while (true) {
+    Track *next = nullptr;
+    for (Track &track : tracks) {
+      if (track.isActive() &&
+          (!next || av_compare_ts(track.next_pts, track.codec->time_base,
+                                  next->next_pts, next->codec->time_base) < 0))
+        next = &track;
+    }
+    // the lines up to the next frame, all of them at the end
+    int64_t untilMS = next ? av_rescale_q(next->next_pts,
+                                          next->codec->time_base,
+                                          AVRational{1, 1000}) + 1
+                           : INT64_MAX;
+    for (Subtitles &track : subtitles) {
+      if (!writeSubtitles(spec, track, oc, untilMS)) {
+        LOG_ERROR("[SyntheticMedia] Writing the subtitles of {} failed",
+                  spec.name);
+        return false;
+      }
+    }
+    if (!next) break;
+    if (!pull(*next, oc)) {
+      LOG_ERROR("[SyntheticMedia] Encoding {} failed", spec.name);
+      return false;
+    }
+  }
+  return av_write_trailer(oc) >= 0;
+}
+
+}  // namespace
+
+std::string syntheticMediaDir() {
+  const char *dir = std::getenv("XPLAYER_BENCH_MEDIA");
+  return dir && *dir ? dir : "/tmp/xplayer_bench";
+}
+
+std::string syntheticClip(const ClipSpec &spec) {
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  fs::path dir = syntheticMediaDir();
+  fs::create_directories(dir, ec);
+  fs::path path = dir / (spec.name + "." + spec.extension);
+  if (fs::exists(path, ec)) return path.string();
+
+  // a killed run leaves a .part behind, never a truncated clip
+  fs::path part = path;
+  part += ".part";
+  if (!encodeClip(spec, part.string())) {
+    fs::remove(part, ec);
+    return {};
+  }
+  fs::rename(part, path, ec);
+  if (ec) return {};
+  LOG_INFO("[SyntheticMedia] Encoded {}", path.string());
+  return path.string();
+}
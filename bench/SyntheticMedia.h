@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+// A clip encoded from lavfi sources, so the benchmarks need no media files
+struct ClipSpec
+{
+  std::string name;  // the cache key, one name per spec
+  int width = 1280;
+  int height = 720;
+  int fps = 30;
+  int seconds = 10;
+  std::string video_codec = "mpeg4";  // empty for no video
+  int gop = 30;
+  std::string audio_codec = "aac";  // empty for no audio
+  int sample_rate = 48000;
+  int channels = 2;
+  int audio_tracks = 1;  // each one a sine an octave above the previous
+  int subtitle_tracks = 0;  // SubRip, a line every second
+  // filter descriptions ending in a single output, testsrc and a 1kHz sine
+  // of the size, rate and length above when empty
+  std::string video_source;
+  std::string audio_source;
+  std::string container = "matroska";
+  std::string extension = "mkv";
+};
+
+// the directory the clips are cached in, $XPLAYER_BENCH_MEDIA or
+// /tmp/xplayer_bench
+std::string syntheticMediaDir();
+// encodes the clip unless it is cached, empty on failure
+std::string syntheticClip(const ClipSpec &spec);
@@ -0,0 +1,40 @@
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "MediaBench.h"
+#include "SyncBench.h"
+#include "xplayer/FFmpegUtil.h"
+#include "xplayer/Log.h"
+
+// Usual Google Benchmark flags. The results also go to xplayer_bench.json
+// unless --benchmark_out is given, to be compared across releases with
+// the compare.py of Google Benchmark. Exits with 1 when the A/V sync
+// benchmarks miss their thresholds.
+int main(int argc, char **argv) {
+  std::vector<char *> args(argv, argv + argc);
+  std::string out = "--benchmark_out=xplayer_bench.json";
+  std::string outFormat = "--benchmark_out_format=json";
+  bool hasOut = false;
+  for (int i = 1; i < argc; i++)
+    if (std::strncmp(argv[i], "--benchmark_out=", 16) == 0) hasOut = true;
+  if (!hasOut) {
+    args.push_back(out.data());
+    args.push_back(outFormat.data());
+  }
+  int count = (int)args.size();
+  args.push_back(nullptr);
+
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data())) return 1;
+  benchmark::AddCustomContext("xplayer_version", XPLAYER_VERSION);
+  benchmark::AddCustomContext("ffmpeg_version", av_version_info());
+
+  setBaseLogLevel(LWARN);
+  registerMediaBenchmarks();
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return syncGateFailed() ? 1 : 0;
+}
@@ -1,8 +1,12 @@
 #pragma once
 
 #include <chrono>
+#include <cmath>
 #include <cstdint>
 
+#include "xplayer/FFmpegUtil.h"
+#include "xplayer/Mutex.h"
+
 class AVClock
 {
 public:
@@ -21,16 +25,110 @@ private:
   std::chrono::steady_clock::time_point last_;
 };
 
-class AVSyncClock
+// A media clock. It carries the last timestamp with its time base and the
+// queue serial it belongs to, anchored at the wall time it was set, and
+// runs at `speed` from there so it can be read between two updates.
+// drift() is the smoothed difference between where the clock had run to
+// and the timestamp of the next update of the same serial, i.e. how the
+// source strays from the wall clock.
+class AVMediaClock
 {
 public:
-  AVSyncClock() = default;
+  AVMediaClock() = default;
 
-  void setTs(int64_t ts) { curr_ts_ = ts; }
-  int64_t current() const { return curr_ts_; }
+  // seconds of the steady clock
+  static double now() {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
 
-  void reset() { curr_ts_ = 0; }
+  void set(int64_t ts, AVRational timeBase, int serial, double speed = 1.0,
+           double time = now()) {
+    Mutex::lock locker(mutex_);
+    double pts = ts * av_q2d(timeBase);
+    double error = at(time) - pts;
+    // a jump is a seek, not a drift
+    if (serial == serial_ && !std::isnan(error) && std::fabs(error) < kMaxDrift)
+      drift_ = drift_ * (1.0 - kDriftWeight) + error * kDriftWeight;
+    ts_ = ts;
+    time_base_ = timeBase;
+    serial_ = serial;
+    anchor_ = time;
+    speed_ = speed;
+  }
+  // seconds, NAN until set
+  double get() const {
+    Mutex::lock locker(mutex_);
+    return at(now());
+  }
+  // NAN as well when the clock belongs to an older serial
+  double get(int serial) const {
+    Mutex::lock locker(mutex_);
+    return serial == serial_ ? at(now()) : NAN;
+  }
+
+  int64_t timestamp() const {
+    Mutex::lock locker(mutex_);
+    return ts_;
+  }
+  AVRational timeBase() const {
+    Mutex::lock locker(mutex_);
+    return time_base_;
+  }
+  int serial() const {
+    Mutex::lock locker(mutex_);
+    return serial_;
+  }
+  // wall time of the last update, seconds of now()
+  double anchor() const {
+    Mutex::lock locker(mutex_);
+    return anchor_;
+  }
+  double drift() const {
+    Mutex::lock locker(mutex_);
+    return drift_;
+  }
+
+  // a paused clock stands still
+  void setPaused(bool paused) {
+    Mutex::lock locker(mutex_);
+    if (paused == paused_) return;
+    double time = now();
+    if (ts_ != AV_NOPTS_VALUE) {
+      // re-anchor at the position reached, on a microsecond time base
+      ts_ = (int64_t)(at(time) * AV_TIME_BASE);
+      time_base_ = AV_TIME_BASE_Q;
+    }
+    anchor_ = time;
+    paused_ = paused;
+  }
+
+  void reset() {
+    Mutex::lock locker(mutex_);
+    ts_ = AV_NOPTS_VALUE;
+    serial_ = -1;
+    drift_ = 0.0;
+    paused_ = false;
+  }
 
 private:
-  int64_t curr_ts_;
+  double at(double time) const {
+    if (ts_ == AV_NOPTS_VALUE) return NAN;
+    double pts = ts_ * av_q2d(time_base_);
+    return paused_ ? pts : pts + (time - anchor_) * speed_;
+  }
+
+private:
+  mutable Mutex::type mutex_;
+  int64_t ts_{AV_NOPTS_VALUE};
+  AVRational time_base_{1, AV_TIME_BASE};
+  int serial_{-1};
+  double anchor_{0.0};
+  double speed_{1.0};
+  double drift_{0.0};
+  bool paused_{false};
+
+  static constexpr double kMaxDrift = 1.0;
+  static constexpr double kDriftWeight = 0.1;
 };
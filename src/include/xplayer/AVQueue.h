@@ -2,6 +2,7 @@
 
 #include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <list>
 #include <condition_variable>
 
@@ -9,6 +10,24 @@
 #include "xplayer/FFmpegUtil.h"
 #include "xplayer/Mutex.h"
 
+// Counters of an AVQueue, read without taking its lock
+struct AVQueueTelemetry
+{
+  size_t depth = 0;
+  size_t high_water = 0;
+  size_t low_water = 0;  // after a pop, 0 before the first one
+  int64_t pushes = 0;
+  int64_t pops = 0;
+  // producers waiting for room
+  int64_t push_blocked_us = 0;
+  int64_t overruns = 0;  // pushes finding the queue full
+  // pop() doesn't block, consumers poll: this is the time from a pop
+  // finding the queue empty until the next item, the current wait included
+  int64_t pop_blocked_us = 0;
+  int64_t underruns = 0;  // pops finding the queue just ran empty
+  int64_t flushed = 0;  // items dropped by clear(), e.g. on a seek
+};
+
 template <typename T>
 class AVQueue{
 public:
@@ -16,31 +35,52 @@ public:
   virtual ~AVQueue() { this->clear(); }
 
   void open() { opened_ = true; }
-  void close() { opened_ = false; }
+  void close() {
+    opened_ = false;
+    { Mutex::lock locker(wait_mutex_); }
+    signal();
+    { Mutex::lock locker(mutex_); }
+    data_cond_.notify_all();
+  }
 
   bool push(const T& x) {
     if (!opened_) return false;
 
-    wait();
+    waitForRoom();
+    if (!opened_) return false;
     Mutex::lock locker(mutex_);
     data_.emplace_back(std::move(x));
+    onPushed();
+    data_cond_.notify_all();
     return true;
   }
   bool push(T&& x) {
     if (!opened_) return false;
 
-    wait();
+    waitForRoom();
+    if (!opened_) return false;
     Mutex::lock locker(mutex_);
     data_.emplace_back(std::move(x));
+    onPushed();
+    data_cond_.notify_all();
     return true;
   }
   bool pop(T& x) {
     if (!opened_) return false;
 
     Mutex::lock locker(mutex_);
-    if (data_.empty()) return false;
+    if (data_.empty()) {
+      // only the first empty pop reads the clock
+      if (starved_since_.load(std::memory_order_relaxed) == AV_NOPTS_VALUE) {
+        starved_since_.store(av_gettime_relative(), std::memory_order_relaxed);
+        if (pops_.load(std::memory_order_relaxed) > 0)
+          underruns_.fetch_add(1, std::memory_order_relaxed);
+      }
+      return false;
+    }
     x = std::move(data_.front());
     data_.pop_front();
+    onPopped();
     if (data_.size() < max_size_ / 5)
       signal();
     return true;
@@ -59,11 +99,49 @@ public:
     return data_.size();
   }
   size_t maxSize() const { return max_size_; }
+  // size() without the lock, possibly a moment old
+  size_t depth() const { return depth_.load(std::memory_order_relaxed); }
   void clear() {
     Mutex::lock locker(mutex_);
+    flushed_.fetch_add((int64_t)data_.size(), std::memory_order_relaxed);
     data_.clear();
+    depth_.store(0, std::memory_order_relaxed);
+    starved_since_.store(AV_NOPTS_VALUE, std::memory_order_relaxed);
     signal();
   }
+
+  AVQueueTelemetry telemetry() const {
+    AVQueueTelemetry t;
+    t.depth = depth_.load(std::memory_order_relaxed);
+    t.high_water = high_water_.load(std::memory_order_relaxed);
+    size_t lowWater = low_water_.load(std::memory_order_relaxed);
+    t.low_water = lowWater == SIZE_MAX ? 0 : lowWater;
+    t.pushes = pushes_.load(std::memory_order_relaxed);
+    t.pops = pops_.load(std::memory_order_relaxed);
+    t.push_blocked_us = push_blocked_us_.load(std::memory_order_relaxed);
+    t.overruns = overruns_.load(std::memory_order_relaxed);
+    t.pop_blocked_us = pop_blocked_us_.load(std::memory_order_relaxed);
+    int64_t since = starved_since_.load(std::memory_order_relaxed);
+    if (since != AV_NOPTS_VALUE) t.pop_blocked_us += av_gettime_relative() - since;
+    t.underruns = underruns_.load(std::memory_order_relaxed);
+    t.flushed = flushed_.load(std::memory_order_relaxed);
+    return t;
+  }
+  // the depth stays, the rest starts over
+  void resetTelemetry() {
+    Mutex::lock locker(mutex_);
+    high_water_.store(data_.size(), std::memory_order_relaxed);
+    low_water_.store(SIZE_MAX, std::memory_order_relaxed);
+    pushes_.store(0, std::memory_order_relaxed);
+    pops_.store(0, std::memory_order_relaxed);
+    push_blocked_us_.store(0, std::memory_order_relaxed);
+    overruns_.store(0, std::memory_order_relaxed);
+    pop_blocked_us_.store(0, std::memory_order_relaxed);
+    underruns_.store(0, std::memory_order_relaxed);
+    flushed_.store(0, std::memory_order_relaxed);
+    if (starved_since_.load(std::memory_order_relaxed) != AV_NOPTS_VALUE)
+      starved_since_.store(av_gettime_relative(), std::memory_order_relaxed);
+  }
   void flush() { clear(); }
 
   bool isOpened() const { return opened_; }
@@ -71,21 +149,71 @@ public:
   int seq() const { return seq_; }
   void step2nextSeq() { seq_++; }
 
+  // a closed queue never blocks the producer
   void wait() {
     Mutex::ulock locker(wait_mutex_);
     cond_.wait(locker, [this]{
-      return (data_.size() < max_size_);
+      return !opened_ || this->size() < max_size_;
     });
   }
   void waitFor(int64_t ms) {
     Mutex::ulock locker(wait_mutex_);
     cond_.wait_for(locker, std::chrono::milliseconds(ms), [this]{
-      return (data_.size() < max_size_);
+      return !opened_ || this->size() < max_size_;
     });
   }
   void signal() {
     cond_.notify_all();
   }
+  // a consumer that can't go on without an item, until one is pushed, the
+  // queue is closed or ms passed
+  void waitForData(int64_t ms) {
+    Mutex::ulock locker(mutex_);
+    data_cond_.wait_for(locker, std::chrono::milliseconds(ms), [this] {
+      return !opened_ || !data_.empty();
+    });
+  }
+  // a producer that waited for room outside push() accounts it here, one
+  // overrun per wait
+  void recordBlocked(int64_t us) {
+    overruns_.fetch_add(1, std::memory_order_relaxed);
+    push_blocked_us_.fetch_add(us, std::memory_order_relaxed);
+  }
+
+protected:
+  // wait() timed when the queue is full
+  void waitForRoom() {
+    if (depth_.load(std::memory_order_relaxed) < max_size_) {
+      wait();
+      return;
+    }
+    overruns_.fetch_add(1, std::memory_order_relaxed);
+    int64_t start = av_gettime_relative();
+    wait();
+    push_blocked_us_.fetch_add(av_gettime_relative() - start,
+                               std::memory_order_relaxed);
+  }
+  // the counters are written with mutex_ held
+  void onPushed() {
+    size_t depth = data_.size();
+    depth_.store(depth, std::memory_order_relaxed);
+    if (depth > high_water_.load(std::memory_order_relaxed))
+      high_water_.store(depth, std::memory_order_relaxed);
+    pushes_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void onPopped() {
+    size_t depth = data_.size();
+    depth_.store(depth, std::memory_order_relaxed);
+    if (depth < low_water_.load(std::memory_order_relaxed))
+      low_water_.store(depth, std::memory_order_relaxed);
+    pops_.fetch_add(1, std::memory_order_relaxed);
+    int64_t since = starved_since_.load(std::memory_order_relaxed);
+    if (since != AV_NOPTS_VALUE) {
+      pop_blocked_us_.fetch_add(av_gettime_relative() - since,
+                                std::memory_order_relaxed);
+      starved_since_.store(AV_NOPTS_VALUE, std::memory_order_relaxed);
+    }
+  }
 
 protected:
   std::atomic_bool opened_{false};
@@ -95,8 +223,21 @@ protected:
 
   Mutex::type wait_mutex_;
   std::condition_variable cond_;
-
-  int seq_{0};
+  std::condition_variable data_cond_;  // with mutex_, see waitForData()
+
+  std::atomic_int seq_{0};
+
+  std::atomic<size_t> depth_{0};
+  std::atomic<size_t> high_water_{0};
+  std::atomic<size_t> low_water_{SIZE_MAX};
+  std::atomic<int64_t> pushes_{0};
+  std::atomic<int64_t> pops_{0};
+  std::atomic<int64_t> push_blocked_us_{0};
+  std::atomic<int64_t> overruns_{0};
+  std::atomic<int64_t> pop_blocked_us_{0};
+  std::atomic<int64_t> underruns_{0};
+  std::atomic<int64_t> flushed_{0};
+  std::atomic<int64_t> starved_since_{AV_NOPTS_VALUE};  // av_gettime_relative()
 };
 
 class AVPacketQueue : public AVQueue<AVPacketPtr> {
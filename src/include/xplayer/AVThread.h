@@ -1,5 +1,10 @@
 #pragma once
 
+#ifdef __linux__
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 #include <atomic>
 #include <condition_variable>
 #include <functional>
@@ -8,7 +13,10 @@
 #include <utility>
 
 #include "Mutex.h"
+#include "ThreadUsage.h"
 
+// The OS thread carries the name, top -H shows it, and its CPU time and
+// context switches can be sampled from other threads through usage().
 class AVThread {
  public:
   AVThread(const std::string& name) : name_(name) {}
@@ -22,7 +30,13 @@ class AVThread {
     //   std::forward<Fn>(f)(std::forward<Args>(args)...);
     // };
     // if (thread_.joinable()) thread_.join();
-    thread_ = std::thread(std::forward<Fn>(f), std::forward<Args>(args)...);
+    auto task = std::bind(std::forward<Fn>(f), std::forward<Args>(args)...);
+    thread_ = std::thread([this, task]() mutable {
+      setCurrentName(name_);
+      probe_.attach();
+      task();
+      probe_.detach();
+    });
   }
 
   void open() {
@@ -44,6 +58,22 @@ class AVThread {
   }
 
   std::string name() const { return name_; }
+  // called from the task itself, join() would deadlock
+  bool isCurrent() const {
+    return thread_.get_id() == std::this_thread::get_id();
+  }
+  // live while it runs, then the totals of the last run
+  ThreadUsage usage() const { return probe_.sample(); }
+  void resetUsage() { probe_.reset(); }
+
+  // the kernel keeps 15 characters. The main thread keeps its name, it is
+  // the process name in ps and top.
+  static void setCurrentName(const std::string& name) {
+#ifdef __linux__
+    if (ThreadProbe::currentTid() == (int)getpid()) return;
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#endif
+  }
 
  protected:
   std::atomic_bool opened_;
@@ -51,6 +81,7 @@ class AVThread {
   std::string name_;
   Mutex::type mutex_;
   std::condition_variable cond_;
+  ThreadProbe probe_;
 
   // std::function<void()> callback_;
 };
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "xplayer/FFmpegUtil.h"
+#include "xplayer/noncopyable.h"
+
+// Changes the tempo of decoded audio keeping its pitch, through an
+// abuffer -> atempo... -> abuffersink graph. Tempos outside [0.5, 2] are
+// split into a chain of atempo filters. Output frames carry pts on the
+// input timeline, so the audio clock keeps following the media.
+class AudioTempo : public noncopyable {
+public:
+  AudioTempo() = default;
+  ~AudioTempo();
+
+  static std::shared_ptr<AudioTempo> create();
+
+  // rebuilds the graph only if the input layout or the tempo changed, a
+  // tempo of 1 passes frames through untouched
+  bool init(const AVFrame *frame, AVRational timeBase, double tempo);
+  bool send(const AVFramePtr &pFrame);
+  // false when more input is needed
+  bool receive(AVFramePtr &pFrame);
+  // drops the buffered samples, e.g. after a seek
+  void reset();
+  void release();
+
+  double tempo() const { return tempo_; }
+  bool isPassthrough() const { return graph_ == nullptr; }
+
+private:
+  bool isDirty(const AVFrame *frame, AVRational timeBase, double tempo) const;
+  bool build();
+
+private:
+  AVFilterGraph *graph_{nullptr};
+  AVFilterContext *source_{nullptr};
+  AVFilterContext *sink_{nullptr};
+
+  double tempo_{1.0};
+  AVRational time_base_{1, 1};
+  int sample_rate_{0};
+  int channels_{0};
+  uint64_t channel_layout_{0};
+  AVSampleFormat format_{AV_SAMPLE_FMT_NONE};
+
+  // input timeline of the output: origin + consumed input samples
+  int64_t origin_pts_{AV_NOPTS_VALUE};
+  int64_t in_samples_{0};
+  int64_t out_samples_{0};
+};
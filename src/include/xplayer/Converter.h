@@ -36,13 +36,14 @@ public:
             int dstWidth, int dstHeight, AVPixelFormat dstFormat);
   bool convert(AVFramePtr pInFrame, AVFramePtr &pOutFrame);
 
-private:
-  bool isDirty(int dstWidth, int dstHeight, AVPixelFormat dstFormat) const;
+  const Info &source() const { return src_; }
+  const Info &destination() const { return dst_; }
 
 private:
-  int last_width_;
-  int last_height_;
-  AVPixelFormat last_format_;
+  bool isDirty(const Info &src, const Info &dst) const;
 
+private:
   SwsContext *sws_context_;
+  Info src_;
+  Info dst_;
 };
\ No newline at end of file
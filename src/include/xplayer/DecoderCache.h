@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "xplayer/FFmpegUtil.h"
+#include "xplayer/noncopyable.h"
+
+// Keeps one opened AVCodecContext alive between media items. When the next
+// stream has compatible codec parameters the context is flushed and reused,
+// a changed extradata is delivered to the decoder as
+// AV_PKT_DATA_NEW_EXTRADATA on the first packet.
+class DecoderCache : public noncopyable {
+public:
+  DecoderCache() = default;
+  ~DecoderCache();
+
+  static std::shared_ptr<DecoderCache> create();
+
+  // returns an opened context for the parameters, nullptr on failure
+  AVCodecContext *acquire(const AVCodecParameters *par);
+  // attaches pending extradata to the first packet after a reuse
+  void prepare(AVPacket *pkt);
+  void flush();
+  void release();
+
+  AVCodecContext *context() const { return codec_context_; }
+  bool isReused() const { return reused_; }
+  // microseconds spent in the last acquire()
+  int64_t lastOpenTime() const { return last_open_us_; }
+
+private:
+  bool isCompatible(const AVCodecParameters *par) const;
+  bool isSameExtradata(const AVCodecParameters *par) const;
+  bool updateExtradata(const AVCodecParameters *par);
+
+private:
+  AVCodecContext *codec_context_{nullptr};
+  AVCodecParameters *params_{nullptr};
+  uint8_t *pending_extradata_{nullptr};
+  int pending_extradata_size_{0};
+  bool reused_{false};
+  int64_t last_open_us_{0};
+};
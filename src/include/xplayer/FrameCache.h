@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+
+#include "xplayer/FFmpegUtil.h"
+#include "xplayer/Mutex.h"
+#include "xplayer/noncopyable.h"
+
+// Memory capped LRU of recently decoded video frames keyed by pts
+// (AV_TIME_BASE). Frames are shared by reference, not copied. Frames that
+// were output one after another by the decoder are linked, so a step to a
+// neighbour is only served when nothing in between is missing.
+class FrameCache : public noncopyable {
+public:
+  struct Stats
+  {
+    int64_t hits = 0;
+    int64_t misses = 0;
+    int64_t frames = 0;
+    int64_t bytes = 0;
+    int64_t capacity = 0;
+
+    double hitRate() const {
+      return hits + misses > 0 ? (double)hits / (hits + misses) : 0.0;
+    }
+  };
+
+public:
+  explicit FrameCache(size_t capacityBytes) : capacity_(capacityBytes) {}
+  ~FrameCache() = default;
+
+  static std::shared_ptr<FrameCache> create(size_t capacityBytes);
+
+  // prevPts is the pts of the frame the decoder output just before,
+  // AV_NOPTS_VALUE after a flush
+  void put(const AVFramePtr &frame, int64_t pts, int64_t prevPts);
+  AVFramePtr find(int64_t pts);
+  // the frame on screen at pts, framePts is its own pts
+  AVFramePtr at(int64_t pts, int64_t &framePts);
+  bool covers(int64_t pts) const;
+  // the decoded neighbours of the frame at pts, nullptr if not cached
+  AVFramePtr previous(int64_t pts, int64_t &prevPts);
+  AVFramePtr next(int64_t pts, int64_t &nextPts);
+
+  void setCapacity(size_t capacityBytes);
+  void clear();
+  Stats stats() const;
+
+  static size_t frameBytes(const AVFrame *frame);
+
+private:
+  struct Node
+  {
+    AVFramePtr frame;
+    size_t bytes;
+    int64_t prev;
+    int64_t next;
+    std::list<int64_t>::iterator lru;
+  };
+
+  std::map<int64_t, Node>::const_iterator locate(int64_t pts) const;
+  AVFramePtr hit(std::map<int64_t, Node>::iterator it);
+  void evict();
+
+private:
+  mutable Mutex::type mutex_;
+  std::map<int64_t, Node> frames_;
+  std::list<int64_t> lru_;  // most recently used first
+  size_t capacity_;
+  size_t bytes_{0};
+  int64_t hits_{0};
+  int64_t misses_{0};
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "xplayer/Mutex.h"
+#include "xplayer/OutputSink.h"
+#include "xplayer/noncopyable.h"
+
+// An audio sink without a device. A thread pulls one buffer after another
+// and either discards it or appends it to a WAV file. Paced, it keeps the
+// samples consumed in step with the wall clock like a device would,
+// otherwise it pulls as fast as the callback returns.
+class HeadlessAudioSink : public AudioSink, public noncopyable {
+public:
+  // a buffer just pulled from the callback: its first sample is
+  // `position` samples per channel into the output and it was pulled at
+  // av_gettime_relative() `timeUS`. A device would start playing it one
+  // buffer later.
+  using BufferTap = std::function<void(const Uint8 *data, int len,
+                                       int64_t position, int64_t timeUS)>;
+
+public:
+  HeadlessAudioSink(std::string wavPath, bool paced);
+  ~HeadlessAudioSink();
+
+  static std::shared_ptr<HeadlessAudioSink> create(const std::string &wavPath,
+                                                   bool paced);
+
+  bool configureAudio(const SDL_AudioSpec &wanted) override;
+  // pausing waits for a callback in progress, like SDL_LockAudioDevice()
+  void pauseAudio(bool paused) override;
+  void releaseAudio() override;
+  bool hasAudio() const override { return thread_.joinable(); }
+  const SDL_AudioSpec &audioSpec() const override { return spec_; }
+
+  bool isPaced() const { return is_paced_; }
+  // samples per channel pulled since configureAudio()
+  int64_t consumedSamples() const { return consumed_samples_; }
+  // called on the sink thread, set it before configureAudio()
+  void setBufferTap(BufferTap tap) { buffer_tap_ = std::move(tap); }
+
+private:
+  void run();
+  bool openWav();
+  void closeWav();
+
+private:
+  std::string wav_path_;
+  bool is_paced_;
+  SDL_AudioSpec spec_{};
+  std::thread thread_;
+  std::atomic_bool is_running_{false};
+  std::atomic_bool is_paused_{true};
+  Mutex::type callback_mutex_;  // held around spec_.callback
+  std::atomic<int64_t> consumed_samples_{0};
+  BufferTap buffer_tap_;
+
+  std::FILE *wav_{nullptr};
+  int64_t wav_data_bytes_{0};
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xplayer/Mutex.h"
+#include "xplayer/noncopyable.h"
+
+// Maps keyframe timestamps (AV_TIME_BASE) to byte positions of one stream.
+// It is only trusted in [0, indexedUntil()], the range that was read
+// contiguously, and is persisted for local media in the user's cache,
+// $XDG_CACHE_HOME/xplayer or ~/.cache/xplayer.
+class KeyframeIndex : public noncopyable {
+public:
+  struct Entry
+  {
+    int64_t pts;
+    int64_t pos;
+  };
+
+public:
+  KeyframeIndex() = default;
+  ~KeyframeIndex() = default;
+
+  static std::shared_ptr<KeyframeIndex> create();
+
+  void reset(int streamIndex);
+  // feeds every packet read without a seek in between
+  void extend(int64_t pts, int64_t pos, bool isKey);
+  // stops extending once the demuxer jumped somewhere else
+  void interrupt() { interrupted_ = true; }
+  void markComplete();
+  // replaces the content with a fully scanned index
+  void assign(std::vector<Entry> entries);
+
+  // the last keyframe at or before pts, O(log n)
+  bool lookup(int64_t pts, Entry &entry) const;
+  bool covers(int64_t pts) const;
+
+  int streamIndex() const { return stream_index_; }
+  int64_t indexedUntil() const;
+  bool isComplete() const;
+  size_t size() const;
+
+  // a saved index is only valid for the same file size and modification
+  // time
+  bool load(const std::string &url);
+  bool save(const std::string &url) const;
+  // keyed by a hash of the absolute path, empty for remote media or
+  // without a cache directory. Saving creates the directory.
+  static std::string cachePath(const std::string &url, bool create = false);
+
+private:
+  static bool statFile(const std::string &path, int64_t &size, int64_t &mtime);
+
+private:
+  mutable Mutex::type mutex_;
+  std::vector<Entry> entries_;
+  int stream_index_{-1};
+  int64_t indexed_until_{-1};
+  bool complete_{false};
+  // set by the read thread, checked before taking the lock
+  std::atomic_bool interrupted_{false};
+  mutable bool dirty_{false};
+
+  static constexpr char kMagic[8] = {'X', 'P', 'I', 'D', 'X', '0', '0', '1'};
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "xplayer/noncopyable.h"
+
+// Lock-free latency histogram in microseconds. Buckets are log-linear like
+// HdrHistogram's: each power of two is split into 16 linear sub-buckets,
+// so a reported value is at most ~6% above the recorded one.
+class LatencyHistogram : public noncopyable {
+public:
+  struct Summary
+  {
+    int64_t count = 0;
+    int64_t mean_us = 0;
+    int64_t p50_us = 0;
+    int64_t p99_us = 0;
+    int64_t max_us = 0;
+    int64_t total_us = 0;  // busy time of the stage
+  };
+
+  // records the time until it goes out of scope
+  class Scope : public noncopyable {
+  public:
+    explicit Scope(LatencyHistogram &histogram);
+    ~Scope();
+
+  private:
+    LatencyHistogram &histogram_;
+    int64_t start_;
+  };
+
+public:
+  LatencyHistogram() { reset(); }
+  ~LatencyHistogram() = default;
+
+  // any thread, negative values count as 0
+  void record(int64_t us);
+  void reset();
+
+  int64_t count() const { return count_.load(std::memory_order_relaxed); }
+  // the upper bound of the bucket holding the value at fraction q, 0..1
+  int64_t percentile(double q) const;
+  Summary summary() const;
+  // cumulative counts at the ascending bounds, like Prometheus buckets: a
+  // bucket straddling a bound counts below it
+  void countsAtMost(const int64_t *boundsUS, int64_t *counts, int n) const;
+
+private:
+  static int bucketOf(int64_t us);
+  static int64_t bucketUpper(int bucket);
+
+private:
+  static constexpr int kSubBits = 4;
+  static constexpr int kSubBuckets = 1 << kSubBits;
+  static constexpr int kMaxBits = 40;  // ~12.7 days, larger values clamp
+  static constexpr int kBuckets = (kMaxBits - kSubBits + 2) * kSubBuckets;
+
+  std::array<std::atomic<int64_t>, kBuckets> buckets_;
+  std::atomic<int64_t> count_;
+  std::atomic<int64_t> sum_;
+  std::atomic<int64_t> max_;
+};
@@ -1,19 +1,16 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
 #include <ctime>
+#include <iterator>
+#include <thread>
 
-#include <fmt/core.h>
+#include <fmt/format.h>
 
-#define LOG_DEBUG(fmt, ...) \
-  log(LDEBUG, time(0), __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
-#define LOG_INFO(fmt, ...) \
-  log(LINFO, time(0), __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
-#define LOG_WARN(fmt, ...) \
-  log(LWARN, time(0), __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
-#define LOG_ERROR(fmt, ...) \
-  log(LERROR, time(0), __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
-#define LOG_FATAL(fmt, ...) \
-  log(LFATAL, time(0), __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
+#include "xplayer/Mutex.h"
+#include "xplayer/noncopyable.h"
 
 enum LogLevel {
   LNONE = 0,
@@ -24,45 +21,111 @@ enum LogLevel {
   LFATAL = 5,
   LCLOSE = 0xFF,
 };
-static LogLevel baseLevel = LDEBUG;
-
-static void setBaseLogLevel(LogLevel level) { baseLevel = level; }
-template <typename... Args>
-static void log(LogLevel level, time_t timestamp, const char *function,
-                int line, fmt::string_view fmt, Args &&...args) {
-  if (baseLevel > level) {
-    return;
+
+// Calls below this level are compiled out together with their arguments,
+// see XPLAYER_LOG_MIN_LEVEL in CMakeLists.txt
+#ifndef XPLAYER_LOG_MIN_LEVEL
+#define XPLAYER_LOG_MIN_LEVEL 1
+#endif
+
+#define XPLAYER_LOG(level, fmt, ...)                                    \
+  do {                                                                  \
+    if (Logger::enabled(level))                                         \
+      Logger::instance().log(level, __FUNCTION__, __LINE__, fmt,        \
+                             ##__VA_ARGS__);                            \
+  } while (0)
+
+#if XPLAYER_LOG_MIN_LEVEL <= 1
+#define LOG_DEBUG(fmt, ...) XPLAYER_LOG(LDEBUG, fmt, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(fmt, ...) ((void)0)
+#endif
+#if XPLAYER_LOG_MIN_LEVEL <= 2
+#define LOG_INFO(fmt, ...) XPLAYER_LOG(LINFO, fmt, ##__VA_ARGS__)
+#else
+#define LOG_INFO(fmt, ...) ((void)0)
+#endif
+#if XPLAYER_LOG_MIN_LEVEL <= 3
+#define LOG_WARN(fmt, ...) XPLAYER_LOG(LWARN, fmt, ##__VA_ARGS__)
+#else
+#define LOG_WARN(fmt, ...) ((void)0)
+#endif
+#define LOG_ERROR(fmt, ...) XPLAYER_LOG(LERROR, fmt, ##__VA_ARGS__)
+#define LOG_FATAL(fmt, ...) XPLAYER_LOG(LFATAL, fmt, ##__VA_ARGS__)
+
+// Asynchronous logger. A call formats the message into a buffer of its own
+// thread and pushes a record to a lock-free MPSC queue, a background writer
+// adds the level and the time and writes batches to stdout. ERROR and
+// FATAL wake the writer and FATAL waits until it is written.
+class Logger : public noncopyable {
+public:
+  static Logger &instance();
+
+  static bool enabled(LogLevel level) {
+    return level >= level_.load(std::memory_order_relaxed);
   }
-  const char *prefix;
-  switch (level) {
-    case LDEBUG:
-      prefix = "\033[34m[DEBUG]\t";
-      break;
-    case LINFO:
-      prefix = "\033[32m[INFO]\t";
-      break;
-    case LWARN:
-      prefix = "\033[33m[WARN]\t";
-      break;
-    case LERROR:
-      prefix = "\033[31;1m[ERROR]\t";
-      break;
-    case LFATAL:
-      prefix = "\033[31;2m[FATAL]\t";
-      break;
-    default:
-      prefix = "[UNKNOWN]\t";
-      break;
+  static void setLevel(LogLevel level) { level_ = level; }
+  static LogLevel level() {
+    return (LogLevel)level_.load(std::memory_order_relaxed);
   }
-  fmt::print(stdout, prefix);
-
-  struct tm tm;
-  localtime_r(&timestamp, &tm);
-  char buffer[20]{};
-  strftime(buffer, 20, "%Y-%m-%d %H:%M:%S", &tm);
-  fmt::print(stdout, buffer);
-
-  fmt::print(stdout, "\t{}:{}\t", function, line);
-  fmt::print(stdout, fmt, std::move(args)...);
-  fmt::println(stdout, "\033[0m");
-}
+
+  template <typename... Args>
+  void log(LogLevel level, const char *function, int line,
+           fmt::string_view format, Args &&...args) {
+    fmt::memory_buffer &buffer = threadBuffer();
+    buffer.clear();
+    fmt::format_to(std::back_inserter(buffer), "{}:{}\t", function, line);
+    fmt::vformat_to(std::back_inserter(buffer), format,
+                    fmt::make_format_args(args...));
+    push(level, buffer.data(), buffer.size());
+  }
+
+  // blocks until everything logged so far is written
+  void flush();
+  // writes synchronously from here on, called at exit
+  void stop();
+
+private:
+  struct Record
+  {
+    std::atomic<Record *> next{nullptr};
+    LogLevel level{LNONE};
+    time_t time{0};
+    size_t size{0};
+    char *text() { return reinterpret_cast<char *>(this + 1); }
+  };
+
+  Logger();
+  ~Logger() = default;
+
+  static fmt::memory_buffer &threadBuffer();
+  void push(LogLevel level, const char *text, size_t size);
+  Record *pop();
+  void run();
+  // single consumer, called with consumer_mutex_ held
+  void drain();
+  void write(fmt::memory_buffer &out, Record *record);
+
+private:
+  static std::atomic<int> level_;
+
+  // Vyukov's intrusive queue, producers exchange the head, the consumer
+  // follows next links from the tail
+  std::atomic<Record *> head_;
+  Record *tail_;
+  Record stub_;
+
+  Mutex::type consumer_mutex_;
+  Mutex::type wake_mutex_;
+  std::condition_variable wake_;
+  std::atomic_bool stopped_{false};
+  std::thread writer_;
+
+  // the formatted time only changes once a second
+  time_t stamp_time_{-1};
+  char stamp_[20]{};
+
+  static constexpr int kWriterIntervalMS = 20;
+};
+
+static inline void setBaseLogLevel(LogLevel level) { Logger::setLevel(level); }
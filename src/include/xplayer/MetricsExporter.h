@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "xplayer/noncopyable.h"
+
+// Serves metrics in the Prometheus text format over HTTP on a 127.0.0.1
+// port or a Unix socket, from a thread of its own. Every scrape of
+// /metrics calls the collector on that thread, one client at a time.
+class MetricsExporter : public noncopyable {
+public:
+  using Collector = std::function<std::string()>;
+
+public:
+  MetricsExporter() = default;
+  ~MetricsExporter();
+
+  static std::shared_ptr<MetricsExporter> create();
+
+  // listens on unixPath, or on the port when it is empty. Port 0 picks a
+  // free one, see port().
+  bool start(int port, const std::string &unixPath, Collector collector);
+  void stop();
+
+  bool isRunning() const { return thread_.joinable(); }
+  int port() const { return port_; }
+  int64_t scrapes() const { return scrapes_; }
+
+private:
+  void run();
+  void serve(int fd);
+
+private:
+  int listen_fd_{-1};
+  int wake_fds_[2]{-1, -1};  // stop() writes to [1]
+  int port_{0};
+  std::string unix_path_;
+  Collector collector_;
+  std::thread thread_;
+  std::atomic<int64_t> scrapes_{0};
+
+  static constexpr int kIOTimeoutMS = 1000;
+  static constexpr size_t kMaxRequestBytes = 8192;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "xplayer/OutputSink.h"
+#include "xplayer/noncopyable.h"
+
+// Consumes pictures without a display. With checksums every picture is
+// hashed with Adler-32 over its visible bytes, so two runs of the same file
+// and config must end with the same checksum().
+class NullVideoSink : public VideoSink, public noncopyable {
+public:
+  // the picture as it is presented and av_gettime_relative() at that moment
+  using PresentTap = std::function<void(const AVFrame *frame, int64_t timeUS)>;
+
+public:
+  explicit NullVideoSink(bool checksum) : is_checksum_(checksum) {}
+  ~NullVideoSink() = default;
+
+  static std::shared_ptr<NullVideoSink> create(bool checksum);
+
+  bool configureVideo(const Spec &spec) override;
+  bool updateVideo(const AVFrame *frame) override;
+  void presentVideo() override;
+  void releaseVideo() override { is_configured_ = false; }
+  bool hasVideo() const override { return is_configured_; }
+
+  int64_t frames() const { return frames_; }
+  int64_t presented() const { return presented_; }
+  // of every picture so far, 1 without any
+  uint32_t checksum() const { return checksum_; }
+  uint32_t lastChecksum() const { return last_checksum_; }
+  void resetCounters();
+  // called on the render thread, set it before playing
+  void setPresentTap(PresentTap tap) { present_tap_ = std::move(tap); }
+
+private:
+  bool is_checksum_;
+  std::atomic_bool is_configured_{false};
+  std::atomic<int64_t> frames_{0};
+  std::atomic<int64_t> presented_{0};
+  std::atomic<uint32_t> checksum_{1};
+  std::atomic<uint32_t> last_checksum_{1};
+
+  PresentTap present_tap_;
+  const AVFrame *pending_{nullptr};  // updated, not presented yet
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+
+#include "SDL2/SDL.h"
+#include "xplayer/FFmpegUtil.h"
+
+// Where SDLPlayer puts converted pictures. SDLOutputContext shows them in a
+// window, NullVideoSink only consumes them.
+class VideoSink {
+public:
+  struct Spec
+  {
+    std::string title;
+    int xleft = 0;
+    int ytop = 0;
+    int width = 0;
+    int height = 0;
+  };
+
+public:
+  virtual ~VideoSink() = default;
+
+  virtual bool configureVideo(const Spec &spec) = 0;
+  // frame is in the configured size, format, width and height are set,
+  // pts is on AV_TIME_BASE or AV_NOPTS_VALUE
+  virtual bool updateVideo(const AVFrame *frame) = 0;
+  virtual void presentVideo() = 0;
+  virtual void releaseVideo() = 0;
+  virtual bool hasVideo() const = 0;
+};
+
+// Pulls samples through the SDL_AudioSpec callback from a thread of its
+// own, like an SDL audio device. It opens paused.
+class AudioSink {
+public:
+  virtual ~AudioSink() = default;
+
+  // the sink may run at another rate, channel count and buffer size, the
+  // caller converts to audioSpec()
+  virtual bool configureAudio(const SDL_AudioSpec &wanted) = 0;
+  virtual void pauseAudio(bool paused) = 0;
+  virtual void releaseAudio() = 0;
+  virtual bool hasAudio() const = 0;
+  virtual const SDL_AudioSpec &audioSpec() const = 0;
+
+  // seconds of audio in one buffer
+  double audioBufferDuration() const {
+    const SDL_AudioSpec &spec = audioSpec();
+    return spec.freq > 0 ? (double)spec.samples / spec.freq : 0.0;
+  }
+};
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <map>
 #include <string>
+#include "Mutex.h"
 #include "PlayerConfig.h"
 #include "noncopyable.h"
 
@@ -18,6 +22,9 @@ public:
     END,
     BROKEN,
   };
+  // called on the thread causing the transition, don't call back into the
+  // player from it
+  using StatusListener = std::function<void(Status oldStatus, Status newStatus)>;
 
   Player() = default;
   virtual ~Player() = default;
@@ -33,6 +40,18 @@ public:
   virtual bool isPlaying() const = 0;
   virtual bool isPaused() const = 0;
 
+  Status status() const { return status_; }
+  // returns an id for removeStatusListener()
+  int addStatusListener(StatusListener listener) {
+    Mutex::lock locker(listener_mutex_);
+    listeners_.emplace(++last_listener_id_, std::move(listener));
+    return last_listener_id_;
+  }
+  void removeStatusListener(int id) {
+    Mutex::lock locker(listener_mutex_);
+    listeners_.erase(id);
+  }
+
   bool isEnableVideo() const { return config_.enable_video; }
   bool isEnableAudio() const { return config_.enable_audio; }
 
@@ -48,7 +67,8 @@ public:
   bool isMuted() const { return config_.audio.is_muted; }
   void setVolume(float volume) { config_.audio.volume = volume; }
   float getVolume() const { return config_.audio.volume; }
-  void setSpeed(float speed) { config_.common.speed = speed; }
+  // negative speeds play backward where supported
+  virtual void setSpeed(float speed) { config_.common.speed = speed; }
   float getSpeed() const { return config_.common.speed; }
 
   // time controller
@@ -57,7 +77,27 @@ public:
   virtual int64_t getCurrentPosition() const = 0;
   virtual int64_t getTotalTime() const = 0;
 
+protected:
+  void setStatus(Status status) {
+    Status oldStatus = status_.exchange(status);
+    if (oldStatus == status) return;
+
+    std::map<int, StatusListener> listeners;
+    {
+      Mutex::lock locker(listener_mutex_);
+      listeners = listeners_;
+    }
+    for (auto &listener : listeners) {
+      listener.second(oldStatus, status);
+    }
+  }
+
 protected:
   PlayerConfig config_{};
-  Status status_{NONE};
+  std::atomic<Status> status_{NONE};
+
+private:
+  Mutex::type listener_mutex_;
+  std::map<int, StatusListener> listeners_;
+  int last_listener_id_{0};
 };
@@ -5,6 +5,12 @@
 #include "FFmpegUtil.h"
 
 struct PlayerConfig {
+  enum SyncMode {
+    AUDIO_MASTER,
+    VIDEO_MASTER,
+    EXTERNAL_MASTER,  // a wall clock, for live streams
+  };
+
   struct video {
     int width = 1280; // < 0 for automatically
     int height = 720; // < 0 for automatically
@@ -12,10 +18,15 @@ struct PlayerConfig {
     int ytop = 0;
     AVPixelFormat format = AV_PIX_FMT_NONE;  // automatically
     float frame_rate = -1.0f;  // < 0 for automatically
+    int frame_cache_mb = 128;  // shown frames kept for stepping, 0 disables
+    int reverse_buffer_mb = 256;  // one decoded GOP for reverse playback
   } video;
   struct audio {
     int channels = 2;
-    int sample_rate = 1024;
+    int sample_rate = 48000;
+    // device buffer target, ~10 for interactive use, larger buffers wake
+    // the audio thread less often
+    int latency_ms = 40;
     AVSampleFormat format = AV_SAMPLE_FMT_NONE;  // automatically
     int bitrate = 0;
     float volume = 1.0f;
@@ -23,7 +34,48 @@ struct PlayerConfig {
   } audio;
   struct common {
     float speed = 1.0f;
+    // trick play from these speeds on: non-reference frames are skipped,
+    // then only keyframes are shown and late GOPs are skipped by seeking
+    float nonref_speed = 2.0f;
+    float keyframe_speed = 4.0f;
+    bool keyframe_index = true;  // seek by byte via an index cached per file
+    bool keyframe_index_scan = false;  // build the whole index in background
+    bool accurate_seek = true;  // seek() decodes up to the exact target
+    // the clock the video is scheduled against, see SDLPlayer::syncMode()
+    SyncMode sync_mode = AUDIO_MASTER;
+    // every stage runs flat out on a virtual clock, to measure throughput.
+    // Implies the headless output, unpaced.
+    bool unpaced = false;
+    // a pipeline stage without progress for this long while playing is
+    // reported as a stall, 0 disables the watchdog
+    int64_t stall_timeout_ms = 2000;
   } common;
+  struct io {
+    // upper bound of a single blocking call, <= 0 for no limit
+    int64_t open_timeout_ms = 10000;
+    int64_t read_timeout_ms = 5000;
+    int64_t seek_timeout_ms = 3000;
+  } io;
+  struct output {
+    // null sinks instead of a window and an audio device
+    bool headless = false;
+    bool checksum = false;  // Adler-32 of every picture, logged at close
+    std::string wav_path;  // audio is written here when not empty
+    bool paced = true;  // false pulls audio as fast as it is decoded
+  } output;
+  struct trace {
+    // Chrome trace JSON of the pipeline, written at exit and on 'T'
+    bool enabled = false;
+    std::string path = "xplayer.trace.json";
+    int events_per_thread = 65536;
+  } trace;
+  struct metrics {
+    // Prometheus text format at /metrics over HTTP on 127.0.0.1:port, or
+    // on unix_socket when it is set
+    bool enabled = false;
+    int port = 9464;
+    std::string unix_socket;
+  } metrics;
   bool enable_audio = true;
   bool enable_video = true;
   bool play_after_ready = true;
@@ -38,12 +90,15 @@ struct PlayerConfig {
       os << "\tY: " << video.ytop << "\n";
       os << "\tFormat: " << video.format << "\n";
       os << "\tFrameRate: " << video.frame_rate << "\n";
+      os << "\tFrame cache: " << video.frame_cache_mb << "MB\n";
+      os << "\tReverse buffer: " << video.reverse_buffer_mb << "MB\n";
     }
     // Audio
     if (enable_audio) {
       os << "Audio: \n";
       os << "\tChannels: " << audio.channels << "\n";
       os << "\tSample rate: " << audio.sample_rate << "\n";
+      os << "\tLatency: " << audio.latency_ms << "ms\n";
       os << "\tFormat: " << audio.format << "\n";
       os << "\tBitrate: " << audio.bitrate << "\n";
       os << "\tVolume: " << audio.volume << "\n";
@@ -51,5 +106,43 @@ struct PlayerConfig {
     }
     // Common
     os << "Speed: " << common.speed << "\n";
+    os << "Trick play: non-ref from " << common.nonref_speed
+       << "x, keyframes from " << common.keyframe_speed << "x\n";
+    os << "Keyframe index: " << std::boolalpha << common.keyframe_index
+       << (common.keyframe_index_scan ? " (scan)" : "") << "\n";
+    os << "Accurate seek: " << std::boolalpha << common.accurate_seek << "\n";
+    os << "Unpaced: " << std::boolalpha << common.unpaced << "\n";
+    os << "Stall timeout: " << common.stall_timeout_ms << "ms\n";
+    os << "Sync mode: "
+       << (common.sync_mode == AUDIO_MASTER   ? "audio"
+           : common.sync_mode == VIDEO_MASTER ? "video"
+                                              : "external")
+       << "\n";
+    // IO
+    os << "IO: \n";
+    os << "\tOpen timeout: " << io.open_timeout_ms << "ms\n";
+    os << "\tRead timeout: " << io.read_timeout_ms << "ms\n";
+    os << "\tSeek timeout: " << io.seek_timeout_ms << "ms\n";
+    // Output
+    if (output.headless) {
+      os << "Output: headless\n";
+      os << "\tChecksum: " << std::boolalpha << output.checksum << "\n";
+      os << "\tWAV: " << output.wav_path << "\n";
+      os << "\tPaced: " << std::boolalpha << output.paced << "\n";
+    }
+    // Trace
+    if (trace.enabled) {
+      os << "Trace: \n";
+      os << "\tPath: " << trace.path << "\n";
+      os << "\tEvents per thread: " << trace.events_per_thread << "\n";
+    }
+    // Metrics
+    if (metrics.enabled) {
+      os << "Metrics: \n";
+      if (metrics.unix_socket.empty())
+        os << "\tPort: " << metrics.port << "\n";
+      else
+        os << "\tSocket: " << metrics.unix_socket << "\n";
+    }
   }
 };
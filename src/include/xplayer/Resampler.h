@@ -36,15 +36,17 @@ public:
   bool init(int srcChannels, AVSampleFormat srcFormat, int srcSampleRate,
             int dstChannels, AVSampleFormat dstFormat, int dstSampleRate);
 
+  // pOutFrame gets the destination layout and the input pts
   bool resample(AVFramePtr pInFrame, AVFramePtr &pOutFrame);
 
+  const Info &source() const { return src_; }
+  const Info &destination() const { return dst_; }
+
  private:
-  bool isDirty(int dstChannels, AVSampleFormat dstFormat,
-               int dstSampleRate) const;
+  bool isDirty(const Info &src, const Info &dst) const;
 
  private:
-  SwrContext *swr_context_;
-  int last_channels_;
-  AVSampleFormat last_format_;
-  int last_sample_rate_;
+  SwrContext *swr_context_{nullptr};
+  Info src_;
+  Info dst_;
 };
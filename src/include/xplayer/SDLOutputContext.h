@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "SDL2/SDL.h"
+#include "xplayer/OutputSink.h"
+#include "xplayer/noncopyable.h"
+
+// Owns the SDL window, renderer, texture and audio device across openUrl()
+// calls. Everything is created on first use and only rebuilt when the
+// requested size or format actually changes.
+class SDLOutputContext : public VideoSink, public AudioSink, public noncopyable {
+public:
+  using VideoSpec = VideoSink::Spec;
+
+public:
+  SDLOutputContext();
+  ~SDLOutputContext();
+
+  static std::shared_ptr<SDLOutputContext> create();
+
+  bool configureVideo(const VideoSpec &spec) override;
+  // uploads to the texture, shown by presentVideo()
+  bool updateVideo(const AVFrame *frame) override;
+  void presentVideo() override;
+  bool configureAudio(const SDL_AudioSpec &wanted) override;
+  void pauseAudio(bool paused) override;
+  // returns a streaming texture, recreated only if format or size changes
+  SDL_Texture *texture(Uint32 format, int width, int height);
+
+  void releaseVideo() override;
+  void releaseAudio() override;
+  void release();
+
+  static SDL_PixelFormatEnum pixelFormatOf(AVPixelFormat format);
+
+  SDL_Window *window() const { return window_; }
+  SDL_Renderer *renderer() const { return renderer_; }
+  SDL_AudioDeviceID audioDevice() const { return audio_device_id_; }
+  const SDL_AudioSpec &audioSpec() const override { return obtained_; }
+  bool hasVideo() const override { return renderer_ != nullptr; }
+  bool hasAudio() const override { return audio_device_id_ > 0; }
+
+  // microseconds spent in the last video/audio (re)configuration
+  int64_t lastVideoSetupTime() const { return last_video_setup_us_; }
+  int64_t lastAudioSetupTime() const { return last_audio_setup_us_; }
+
+private:
+  static bool isSameAudioSpec(const SDL_AudioSpec &lhs, const SDL_AudioSpec &rhs);
+
+private:
+  // video
+  SDL_Window *window_{nullptr};
+  SDL_Renderer *renderer_{nullptr};
+  SDL_Texture *texture_{nullptr};
+  VideoSpec video_spec_;
+  Uint32 texture_format_{0};
+  int texture_width_{0};
+  int texture_height_{0};
+  // audio
+  SDL_AudioDeviceID audio_device_id_{0};
+  SDL_AudioSpec wanted_{};
+  SDL_AudioSpec obtained_{};
+
+  int64_t last_video_setup_us_{0};
+  int64_t last_audio_setup_us_{0};
+};
@@ -1,19 +1,123 @@
 #pragma once
 
 #include "xplayer/Player.h"
-#include "xplayer/AVAudioBuffer.h"
 #include "xplayer/AVThread.h"
 #include "xplayer/AVQueue.h"
 #include "xplayer/Resampler.h"
 #include "xplayer/Converter.h"
 #include "xplayer/AVClock.h"
+#include "xplayer/AudioTempo.h"
+#include "xplayer/DecoderCache.h"
+#include "xplayer/FrameCache.h"
+#include "xplayer/KeyframeIndex.h"
+#include "xplayer/LatencyHistogram.h"
+#include "xplayer/MetricsExporter.h"
+#include "xplayer/HeadlessAudioSink.h"
+#include "xplayer/NullVideoSink.h"
+#include "xplayer/SDLOutputContext.h"
+#include "xplayer/StallDetector.h"
+#include "xplayer/Tracer.h"
 
 #include "SDL2/SDL.h"
 #include "SDL2/SDL_audio.h"
+#include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
 #include <memory>
+#include <vector>
 
 // TODO: 使用 error_ 记录错误信息，支持音视频流同步播放，解决内存泄露问题
 class SDLPlayer : public Player {
+public:
+  struct DemuxStats
+  {
+    std::atomic<int64_t> packets{0};
+    std::atomic<int64_t> dropped_packets{0};  // read but not selected
+    std::atomic<int64_t> payload_bytes{0};
+    std::atomic<int64_t> io_bytes{0};  // bytes the demuxer advanced through
+    std::atomic<int64_t> seeks{0};  // demuxer seeks, see lastSeekTime()
+    std::atomic<int64_t> failed_seeks{0};  // failed or timed out
+
+    void reset() {
+      packets = dropped_packets = payload_bytes = io_bytes = 0;
+      seeks = failed_seeks = 0;
+    }
+  };
+
+  enum TrickMode {
+    TRICK_NONE,
+    TRICK_NONREF,  // the decoder skips non-reference frames
+    TRICK_KEYFRAMES,  // only keyframes are read and decoded
+  };
+
+  // where a packet or frame spends its time, see stats()
+  enum PipelineStage {
+    STAGE_READ,  // av_read_frame()
+    STAGE_VIDEO_DECODE,  // a packet sent until its frame is received
+    STAGE_VIDEO_QUEUE,  // a decoded frame until the render loop takes it
+    STAGE_CONVERT,
+    STAGE_UPLOAD,  // texture update
+    STAGE_PRESENT,  // render copy and present
+    STAGE_AUDIO_DECODE,
+    STAGE_AUDIO_CALLBACK,
+    STAGE_COUNT,
+  };
+
+  // the threads a file plays on, see threadUsage()
+  enum PipelineThread {
+    THREAD_READ,
+    THREAD_VIDEO_DECODE,
+    THREAD_AUDIO_DECODE,
+    THREAD_RENDER,  // the thread calling play()
+    THREAD_AUDIO_CALLBACK,  // SDL's audio thread
+    THREAD_COUNT,
+  };
+
+  struct Stats
+  {
+    LatencyHistogram::Summary stages[STAGE_COUNT];
+    FrameCache::Stats frame_cache;
+    int64_t sync_error_us = 0;
+    // output since the first frame or sample, what unpaced runs measure
+    int64_t frames = 0;
+    int64_t audio_samples = 0;
+    int64_t elapsed_us = 0;
+    // CPU time and context switches per thread since the file started,
+    // live while it plays
+    ThreadUsage threads[THREAD_COUNT];
+    AVQueueTelemetry video_packets;
+    AVQueueTelemetry video_frames;
+    AVQueueTelemetry audio_packets;
+    AVQueueTelemetry audio_frames;
+    int64_t stalls = 0;
+
+    double fps() const {
+      return elapsed_us > 0 ? frames * 1e6 / elapsed_us : 0.0;
+    }
+    double audioSamplesPerSecond() const {
+      return elapsed_us > 0 ? audio_samples * 1e6 / elapsed_us : 0.0;
+    }
+  };
+
+  // a stage stopped or resumed making progress while playing. The cause
+  // is the stage holding it up through empty or full queues: STAGE_READ
+  // for I/O, a decode stage, STAGE_PRESENT for the renderer or
+  // STAGE_AUDIO_CALLBACK for the audio output.
+  struct StallEvent
+  {
+    PipelineStage stage = STAGE_READ;
+    PipelineStage cause = STAGE_READ;
+    int64_t duration_ms = 0;  // without progress, in total when recovered
+    bool is_recovered = false;
+  };
+
+public:
+  using OpenCallback = std::function<void(bool success)>;
+  // called on the watchdog thread
+  using StallListener = std::function<void(const StallEvent &event)>;
+
 public:
   SDLPlayer();
   ~SDLPlayer();
@@ -23,6 +127,13 @@ public:
   bool init(PlayerConfig config) override;
   void destroy() override;
   bool openUrl(const std::string &url) override;
+  // probes and opens the decoders off the calling thread, the SDL output is
+  // configured by the next play(). play_after_ready is ignored here. From
+  // a completion callback the open is queued until the callback returned,
+  // so don't wait there for the future. close() aborts the open and fails
+  // the queued ones.
+  std::future<bool> openUrlAsync(const std::string &url);
+  void openUrlAsync(const std::string &url, OpenCallback callback);
 
   bool play() override;
   bool replay() override;
@@ -31,91 +142,308 @@ public:
 
   bool isPlaying() const override { return status_ == Player::PLAYING; }
   bool isPaused() const override { return status_ == Player::PAUSED; }
+  // a negative speed plays the video backward GOP by GOP, the audio is
+  // muted meanwhile
+  void setSpeed(float speed) override;
+  bool isReversing() const { return is_reversing_; }
+  TrickMode trickMode() const { return trick_mode_; }
 
   // miliseconds
   void seek(int64_t position) override;
+  // timeline scrubbing: only the newest position is sought, showing the
+  // nearest keyframe, endScrub() does an accurate seek to the last one
+  void scrub(int64_t position);
+  void endScrub();
+  bool isScrubbing() const { return is_scrubbing_; }
+  // a seek was requested and its first frame isn't displayed yet
+  bool isSeeking() const { return need2seek_ || seek_request_time_ != 0; }
+  // pauses and shows the next (> 0) or the previous (< 0) frame, recently
+  // shown frames are served by the frame cache
+  void stepFrame(int direction);
   // miliseconds
   int64_t getCurrentPosition() const override;
   // miliseconds
   int64_t getTotalTime() const override;
 
   std::string lastError() const { return error_; }
+  std::shared_ptr<SDLOutputContext> outputContext() const { return output_; }
+  // replaces the sinks picked by init(), before openUrl()
+  void setSinks(std::shared_ptr<VideoSink> videoSink,
+                std::shared_ptr<AudioSink> audioSink);
+  std::shared_ptr<VideoSink> videoSink() const { return video_sink_; }
+  std::shared_ptr<AudioSink> audioSink() const { return audio_sink_; }
+  // microseconds spent in the last openUrl()
+  int64_t lastOpenTime() const { return last_open_us_; }
   std::string dump() const;
 
+  // stream indexes of every track of the type in the opened media
+  std::vector<int> tracks(AVMediaType type) const;
+  int audioTrack() const { return audio_stream_index_; }
+  int videoTrack() const { return video_stream_index_; }
+  // switches at runtime, playback goes on from the current position
+  bool switchAudioTrack(int streamIndex);
+  bool switchVideoTrack(int streamIndex);
+  const DemuxStats &demuxStats() const { return demux_stats_; }
+  std::shared_ptr<KeyframeIndex> keyframeIndex() const { return keyframe_index_; }
+  std::shared_ptr<DecoderCache> audioDecoder() const { return audio_decoder_; }
+  std::shared_ptr<DecoderCache> videoDecoder() const { return video_decoder_; }
+  // microseconds spent in the last demuxer seek
+  int64_t lastSeekTime() const { return last_seek_us_; }
+  // microseconds from the last executed seek request to its first
+  // displayed frame, its first decoded audio frame without video
+  int64_t lastSeekDisplayTime() const { return last_seek_display_us_; }
+  // seconds on the stream timeline, NAN before the first update
+  double audioClock() const { return audio_clock_.get(); }
+  double videoClock() const { return video_clock_.get(); }
+  double externalClock() const { return external_clock_.get(); }
+  // the configured sync mode unless the media or the playback mode can't
+  // follow it: without audio, backward and in trick play the video leads
+  PlayerConfig::SyncMode syncMode() const;
+  // seconds, NAN while the master clock belongs to an older serial
+  double masterClock() const;
+  // video minus master clock at the last scheduled frame, microseconds
+  int64_t syncError() const { return sync_error_us_; }
+  // smoothed deviation of the audio device from the wall clock, seconds
+  double audioClockDrift() const { return audio_clock_.drift(); }
+  // microseconds from the audio callback to the speaker: the buffer just
+  // written and the one the device is playing
+  int64_t audioLatency() const {
+    return (int64_t)(2 * audio_sink_->audioBufferDuration() * AV_TIME_BASE);
+  }
+  FrameCache::Stats frameCacheStats() const { return frame_cache_->stats(); }
+  // a snapshot of the current file, dumped to the log at close
+  Stats stats() const;
+  // the snapshot taken by the last close() of a file that played
+  Stats lastStats() const;
+  static const char *stageName(PipelineStage stage);
+  static const char *threadName(PipelineThread thread);
+  ThreadUsage threadUsage(PipelineThread thread) const;
+  // Prometheus text format of the counters, reads only atomics so a
+  // scrape never waits on the pipeline
+  std::string metrics() const;
+  std::shared_ptr<MetricsExporter> metricsExporter() const {
+    return metrics_exporter_;
+  }
+  // set it before openUrl()
+  void setStallListener(StallListener listener) {
+    stall_listener_ = std::move(listener);
+  }
+
   bool isAVStreamBoth() const { return enable_video_ && enable_audio_; }
   bool isVideoStreamOnly() const { return enable_video_ && !enable_audio_; }
   bool isAudioStreamOnly() const { return !enable_video_ && enable_audio_; }
 
 private:
+  bool openInput(const std::string &url);
+  bool openOutput();
+
   bool checkConfig();
   bool expect(bool condition, const std::string &error);
 
+  bool isTrackOf(int streamIndex, AVMediaType type) const;
+  void applyStreamDiscard();
+  void applyTrackSwitch();
+  bool reopenDecoderIfSwitched(DecoderCache &decoder,
+                               AVCodecContext *&codecContext,
+                               int &decodingIndex, int streamIndex);
+
+  void requestSeek(int64_t position, bool accurate);
+  // AV_TIME_BASE on the stream timeline
+  void submitSeek(int64_t target, bool accurate);
+  int seekInput(int64_t target);
+  void readPreviousGop();
+  bool readGop(std::vector<AVPacketPtr> &gop);
+  int64_t startTime() const;
+  TrickMode trickModeOf(float speed) const;
+  // media time of the trick play clock, AV_NOPTS_VALUE until anchored
+  int64_t trickClock() const;
+  void onScanKeyframes(std::string url, int streamIndex);
+
   void onPlay();
   void onReadFrame();
   void onSDLAudioPlay(Uint8 *stream, int len);
+  bool nextAudioFrame();
+  // converts to the device format before queueing, false if dropped
+  bool pushAudioFrame(AVFramePtr pFrame);
+  // the first frame of a seek's serial is out: ends the seek request
+  void onSeekShown();
   void onSDLVideoPlay();
+  // after changing what a paused or resyncing render loop waits for
+  void wakeRenderLoop();
   void onAudioDecodeFrame();
   void onVideoDecodeFrame();
 
+  enum PresentResult {
+    PRESENT_OK,
+    PRESENT_SKIPPED,  // the frame couldn't be converted, nothing was shown
+    PRESENT_FAILED,  // the video output is gone
+  };
+  PresentResult presentFrame(const AVFramePtr &pFrame);
   void videoDelay();
+  // restarts the external clock from a slave that went too far from it,
+  // serial is the slave's current one
+  void syncExternalClock(const AVMediaClock &slave, int serial);
+  void reportSyncError(int64_t errorUS);
+  // the time of a frame or samples reaching the output
+  void markOutput();
+  void reportThroughput();
+  void onWatchStalls();
+  void onStall(const StallDetector::Stall &stall);
+  PipelineStage stallCause(PipelineStage stage) const;
 
   void onPauseToggle();
 
-  static SDL_PixelFormatEnum convertFFmpegPixelFormatToSDLPixelFormat(AVPixelFormat format);
   static int convertFFmpegSampleFormatToSDLSampleFormat(AVSampleFormat format);
+  static AVSampleFormat convertSDLSampleFormatToFFmpegSampleFormat(
+      SDL_AudioFormat format);
+  // the power of two buffer size closest above the latency
+  static Uint16 latencyToSamples(int latencyMS, int sampleRate);
   static void sdlAudioCallback(void *userdata, Uint8* stream, int len);
+  // AV_TIME_BASE, AV_NOPTS_VALUE if unknown
+  static int64_t frameTime(const AVFrame *frame, AVRational timeBase);
+  static int64_t packetTime(const AVPacket *packet, AVRational timeBase);
+  static AVFramePtr trimAudioFrame(AVFramePtr pFrame, int skip,
+                                   AVRational timeBase);
+  // 0 disables the deadline of the next blocking I/O call
+  void setIODeadline(int64_t timeoutMS);
+  static int interruptCallback(void *opaque);
+  static int scanInterruptCallback(void *opaque);
+  static std::string errorString(int errnum);
+
+private:
+  struct SeekRequest
+  {
+    int64_t target{0};  // AV_TIME_BASE
+    bool accurate{false};
+    int64_t request_time{0};  // av_gettime_relative()
+  };
 
 private:
   std::string url_;
   bool enable_video_{false};
   bool enable_audio_{false};
-  AVFormatContext *format_context_;
+  AVFormatContext *format_context_{nullptr};
+  int fifo_fd_{-1};  // a FIFO input, read through pipe:
+  AVThread open_thread_{"OpenThread"};
+  // openUrlAsync() from a completion callback, run next by the open thread
+  Mutex::type open_mutex_;
+  std::deque<std::pair<std::string, OpenCallback>> pending_opens_;
   AVThread read_thread_{"ReadThread"};
-  AVThread audio_decode_thread_{"AudioDecodeThread"};
-  AVThread video_decode_thread_{"VideoDecodeThread"};
+  AVThread audio_decode_thread_{"AudioDecode"};
+  AVThread video_decode_thread_{"VideoDecode"};
   AVThread play_thread_{"PlayThread"};
-  int seq_;
+  AVThread index_thread_{"IndexThread"};
+  AVThread stall_thread_{"StallThread"};
+  // bumped by every seek, the external clock's serial
+  std::atomic_int seq_{0};
   // ForwardGeneric seq_;
   Mutex::type read_mutex_;
   std::condition_variable continue_read_cond_;
 
   // audio
-  int audio_stream_index_{-1};
-  AVCodecContext *audio_codec_context_;
+  std::atomic_int audio_stream_index_{-1};
+  std::atomic_int pending_audio_track_{-1};
+  AVCodecContext *audio_codec_context_{nullptr};
+  std::shared_ptr<DecoderCache> audio_decoder_;
   AVPacketQueue audio_packet_queue_{kMaxAudioFrame};
   AVFrameQueue audio_frame_queue_{kMaxAudioFrame};
   // video
-  int video_stream_index_{-1};
-  AVCodecContext *video_codec_context_;
+  std::atomic_int video_stream_index_{-1};
+  std::atomic_int pending_video_track_{-1};
+  AVCodecContext *video_codec_context_{nullptr};
+  std::shared_ptr<DecoderCache> video_decoder_;
   AVPacketQueue video_packet_queue_{kMaxVideoFrame};
   AVFrameQueue video_frame_queue_{kMaxVideoFrame};
 
-  SDL_AudioDeviceID audio_device_id_;
-  std::unique_ptr<AVAudioBuffer> audio_buffer_;
-  std::shared_ptr<uint8_t> audio_buf_;
-  int audio_buf_index_;
-  int audio_buf_size_;
+  // the frame the audio callback is consuming
+  AVFramePtr audio_frame_;
+  int audio_buf_index_{0};
+  int audio_buf_size_{0};
+  int audio_frame_serial_{0};
+  double audio_frame_end_{NAN};  // pts at the end of audio_frame_, seconds
 
-  std::shared_ptr<Resampler> resampler_;
+  std::shared_ptr<Resampler> resampler_;  // audio decode thread only
+  Resampler::Info audio_target_;  // the device format, set by openOutput()
+  std::shared_ptr<AudioTempo> audio_tempo_;  // audio decode thread only
   std::shared_ptr<Converter> converter_;
 
-  bool is_finished_{false};
-  bool is_over_{false};
-  bool need2pause_{false};
+  int64_t last_open_us_{0};
+  DemuxStats demux_stats_;
+  std::array<LatencyHistogram, STAGE_COUNT> stage_latency_;
+  mutable Mutex::type last_stats_mutex_;
+  Stats last_stats_;
+  std::atomic<int64_t> frames_presented_{0};
+  std::atomic<int64_t> audio_samples_played_{0};
+  std::atomic<int64_t> output_start_us_{AV_NOPTS_VALUE};
+  std::atomic<int64_t> output_last_us_{AV_NOPTS_VALUE};
+  ThreadProbe render_probe_;
+  ThreadProbe audio_callback_probe_;
+  std::shared_ptr<StallDetector> stall_detector_;  // per file
+  std::atomic<int64_t> stalls_{0};
+  StallListener stall_listener_;
+  std::shared_ptr<MetricsExporter> metrics_exporter_;
+  Mutex::type stall_mutex_;
+  std::condition_variable stall_cond_;
+
+  // config_.common.speed as set by setSpeed(), read by the pipeline threads
+  std::atomic<float> speed_{1.0f};
+  std::atomic_bool is_finished_{false};
+  std::atomic_bool is_over_{false};
+  std::atomic_bool need2pause_{false};
+  std::atomic_bool need2open_output_{false};
+  // the audio decoder waits on it for play() to configure the output, the
+  // render loop while paused
+  Mutex::type output_mutex_;
+  std::condition_variable output_cond_;
+  std::atomic<int64_t> io_deadline_{0};  // av_gettime_relative() based
   // Sync
   // miliseconds
-  int64_t seek_pos_;
-  bool need2seek_{false};
-  AVClock clocker_;
+  Mutex::type seek_mutex_;
+  SeekRequest seek_request_;
+  std::atomic_bool need2seek_{false};
+  std::atomic_bool is_scrubbing_{false};
+  int64_t scrub_position_{0};  // miliseconds
+  std::atomic_int seek_coalesced_count_{0};
+  std::shared_ptr<KeyframeIndex> keyframe_index_;
+  std::shared_ptr<FrameCache> frame_cache_;
+  // a seek the render loop serves from the frame cache, AV_TIME_BASE
+  std::atomic<int64_t> cache_seek_target_{AV_NOPTS_VALUE};
+  std::atomic_int pending_step_{0};
+  // reverse playback, set by the read thread along with a new serial
+  std::atomic_bool is_reversing_{false};
+  std::atomic<int64_t> reverse_end_{AV_NOPTS_VALUE};  // next GOP ends here
+  std::atomic_int reverse_gops_{0};  // queued but not emitted yet
+  // trick play, set by the read thread along with a new serial. Frames are
+  // shown when the clock anchored at the first one of the serial gets there.
+  std::atomic<TrickMode> trick_mode_{TRICK_NONE};
+  std::atomic<int64_t> trick_anchor_pts_{AV_NOPTS_VALUE};
+  std::atomic<int64_t> trick_anchor_time_{0};
+  std::atomic<int64_t> last_seek_us_{0};
+  // accurate seek targets of the current queue serials, AV_TIME_BASE
+  std::atomic<int64_t> audio_seek_target_{AV_NOPTS_VALUE};
+  std::atomic<int64_t> video_seek_target_{AV_NOPTS_VALUE};
+  // request time of the executed seek until its first frame is displayed
+  std::atomic<int64_t> seek_request_time_{0};
+  std::atomic<int64_t> last_seek_display_us_{0};
   int64_t last_paused_time_{0};  // for cache
-  int audio_clock_serial_;
-  AVSyncClock audio_clock_;
-  AVSyncClock video_clock_;
-  AVSyncClock *external_clock_; // always pointer to audio_clock
+  double frame_timer_{NAN};  // when the shown frame was due, render thread
+  std::atomic<int64_t> sync_error_us_{0};
+  // sync error metric of the current report window, render thread
+  int64_t sync_error_sum_us_{0};
+  int64_t sync_error_max_us_{0};
+  int64_t sync_error_count_{0};
+  double sync_report_time_{NAN};
+  // seconds, the audio clock follows what is audible
+  AVMediaClock audio_clock_;
+  AVMediaClock video_clock_;
+  AVMediaClock external_clock_;
 
   // SDL2
-  SDL_Window *window_;
-  SDL_Renderer *renderer_;
+  std::shared_ptr<SDLOutputContext> output_;
+  // output_ unless headless
+  std::shared_ptr<VideoSink> video_sink_;
+  std::shared_ptr<AudioSink> audio_sink_;
+  bool is_windowed_{true};  // SDL events are polled
 
   std::string error_;
 
@@ -123,5 +451,14 @@ private:
   static constexpr size_t kMaxVideoFrame = 300;
   static constexpr size_t kMinAudioFrame = kMaxAudioFrame / 5;
   static constexpr size_t kMinVideoFrame = kMaxVideoFrame / 5;
-  static constexpr size_t kMaxAudioBufferSize = 500 * 1000;
+  // ffplay's thresholds, seconds
+  static constexpr double kSyncThresholdMin = 0.04;
+  static constexpr double kSyncThresholdMax = 0.1;
+  static constexpr double kSyncFramedupThreshold = 0.1;
+  static constexpr double kNoSyncThreshold = 10.0;
+  static constexpr double kSyncReportInterval = 5.0;
+  static constexpr int kMinAudioSamples = 64;
+  static constexpr int kMaxAudioSamples = 32768;
+  // how far ahead of the trick play clock a skipped GOP lands, wall time
+  static constexpr int64_t kTrickLeadUS = 200 * 1000;
 };
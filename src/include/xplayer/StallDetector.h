@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "xplayer/noncopyable.h"
+
+// Watches counters that grow while a stage works. A stage whose counter
+// stands still for the timeout while it is expected to move is stalled,
+// poll() reports it once and again when it moves on. Stages are added
+// before polling starts, polling is done by a single thread.
+class StallDetector : public noncopyable {
+public:
+  using Progress = std::function<int64_t()>;
+  // false while the stage has nothing to do, e.g. the reader after EOF
+  using Expected = std::function<bool()>;
+
+  struct Stall
+  {
+    int stage = 0;
+    int64_t duration_us = 0;  // without progress so far, or in total
+    bool is_recovered = false;
+  };
+
+public:
+  explicit StallDetector(int64_t timeoutUS) : timeout_us_(timeoutUS) {}
+  ~StallDetector() = default;
+
+  static std::shared_ptr<StallDetector> create(int64_t timeoutMS);
+
+  void addStage(int stage, Progress progress, Expected expected);
+  void clear();
+  // starts the timers over, after a pause or a seek
+  void restart(int64_t nowUS);
+  // stalls that began or ended since the last poll
+  std::vector<Stall> poll(int64_t nowUS);
+
+  int64_t timeout() const { return timeout_us_; }
+  // stalls reported since the detector was created
+  int64_t stalls() const { return stalls_; }
+
+private:
+  struct Stage
+  {
+    int id;
+    Progress progress;
+    Expected expected;
+    int64_t last_value;
+    int64_t last_change_us;
+    bool is_stalled;
+  };
+
+private:
+  int64_t timeout_us_;
+  std::vector<Stage> stages_;
+  std::atomic<int64_t> stalls_{0};
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <time.h>
+
+#include <atomic>
+#include <cstdint>
+
+#include "xplayer/noncopyable.h"
+
+// CPU time and context switches of a thread. Linux only, zeros elsewhere.
+struct ThreadUsage
+{
+  int64_t cpu_us = 0;
+  int64_t voluntary_switches = 0;  // gave up the CPU: I/O, locks, sleeps
+  int64_t involuntary_switches = 0;  // preempted, the CPU is contended
+
+  // of the calling thread, CLOCK_THREAD_CPUTIME_ID and RUSAGE_THREAD
+  static ThreadUsage self();
+
+  ThreadUsage operator-(const ThreadUsage &other) const {
+    return {cpu_us - other.cpu_us,
+            voluntary_switches - other.voluntary_switches,
+            involuntary_switches - other.involuntary_switches};
+  }
+};
+
+// Samples a thread from any other, lock-free, counting from attach(). The
+// probed thread attaches itself; after it detaches, or if it ended
+// without, sample() returns the last values seen.
+class ThreadProbe : public noncopyable {
+public:
+  ThreadProbe() = default;
+  ~ThreadProbe() = default;
+
+  // on the thread to probe
+  void attach();
+  void detach();
+  // forgets the thread and its usage
+  void reset();
+  bool isAttached() const { return is_attached_; }
+  // the probed thread is the calling one
+  bool isCurrent() const;
+
+  ThreadUsage sample() const;
+
+  static int currentTid();
+
+private:
+  ThreadUsage base() const;
+  void store(const ThreadUsage &usage) const;
+
+private:
+  std::atomic_bool is_attached_{false};
+  std::atomic<int> tid_{0};
+  std::atomic<clockid_t> clock_{0};
+  // at attach()
+  std::atomic<int64_t> base_cpu_us_{0};
+  std::atomic<int64_t> base_voluntary_switches_{0};
+  std::atomic<int64_t> base_involuntary_switches_{0};
+  // the last sample
+  mutable std::atomic<int64_t> cpu_us_{0};
+  mutable std::atomic<int64_t> voluntary_switches_{0};
+  mutable std::atomic<int64_t> involuntary_switches_{0};
+};
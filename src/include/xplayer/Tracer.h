@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xplayer/FFmpegUtil.h"
+#include "xplayer/Mutex.h"
+#include "xplayer/noncopyable.h"
+
+// Records pipeline events into per-thread ring buffers and exports them as
+// Chrome trace JSON (chrome://tracing, ui.perfetto.dev). While disabled a
+// TraceScope costs a single branch on a relaxed atomic load.
+class Tracer : public noncopyable {
+public:
+  // a complete event, begin and duration in microseconds
+  struct Event
+  {
+    const char *name;
+    int64_t ts;
+    int64_t dur;
+    int64_t pts;  // AV_TIME_BASE or AV_NOPTS_VALUE
+    int stream;
+    int serial;
+  };
+
+public:
+  static Tracer &instance();
+
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+  // each thread keeps its last eventsPerThread events, they are written to
+  // path at exit if it isn't empty
+  void start(const std::string &path, size_t eventsPerThread);
+  void stop();
+  void clear();
+  bool exportJson(const std::string &path) const;
+
+  // shown as the thread's name in the trace
+  static void setThreadName(const char *name);
+  void record(const Event &event);
+
+private:
+  struct ThreadBuffer
+  {
+    Mutex::type mutex;  // only contended by an export
+    std::vector<Event> events;
+    size_t next = 0;
+    bool wrapped = false;
+    int tid = 0;
+    std::string name;
+  };
+
+  Tracer() = default;
+  ~Tracer() = default;
+
+  ThreadBuffer *threadBuffer();
+
+private:
+  static std::atomic<bool> enabled_;
+
+  mutable Mutex::type mutex_;
+  // kept after their thread exits, until clear()
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+  size_t capacity_{0};
+  std::string path_;
+  bool exit_hook_{false};
+};
+
+// Traces the enclosing scope as one event.
+class TraceScope {
+public:
+  explicit TraceScope(const char *name, int stream = -1,
+                      int64_t pts = AV_NOPTS_VALUE, int serial = -1)
+      : event_{name, 0, 0, pts, stream, serial} {
+    if (Tracer::enabled()) event_.ts = av_gettime_relative();
+  }
+  ~TraceScope() {
+    if (event_.ts == 0) return;
+    event_.dur = av_gettime_relative() - event_.ts;
+    Tracer::instance().record(event_);
+  }
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+  // for what is only known once the work is done
+  void tag(int stream, int64_t pts, int serial) {
+    event_.stream = stream;
+    event_.pts = pts;
+    event_.serial = serial;
+  }
+
+private:
+  Tracer::Event event_;
+};
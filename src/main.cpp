@@ -2,7 +2,9 @@
 #include "xplayer/SDLPlayer.h"
 #include "xplayer/Log.h"
 
+#include <condition_variable>
 #include <csignal>
+#include <mutex>
 
 void sig_handler(int sig) {
   exit(0);
@@ -41,7 +43,15 @@ int main()
     // "/home/youmu/Desktop/media/【東方】Bad Apple!! ＰＶ【影絵】-VP9-360p-FtutLA63Cp8.mp4",
   };
 
+  std::mutex statusMutex;
+  std::condition_variable statusCond;
+
   auto player = SDLPlayer::create(config);
+  player->addStatusListener([&](Player::Status oldStatus, Player::Status newStatus) {
+    LOG_INFO("Player status: {} -> {}", (int)oldStatus, (int)newStatus);
+    { std::lock_guard<std::mutex> locker(statusMutex); }
+    statusCond.notify_all();
+  });
   while (true) {
     if (mediaPlaylist.empty()) {
       LOG_INFO("Waiting for next media...");
@@ -54,12 +64,21 @@ int main()
     mediaPlaylist.pop_front();
 
     player->init(config);
-    player->openUrl(url);
+    auto opened = player->openUrlAsync(url);
+    if (!opened.get()) {
+      LOG_ERROR("Failed to open {}: {}", url, player->lastError());
+      continue;
+    }
     // player->seek(100000);
+    // renders on this thread until the media ends
     player->play();
-    while (player->isPlaying()) {
-      std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    {
+      std::unique_lock<std::mutex> locker(statusMutex);
+      statusCond.wait(locker, [&] {
+        return !player->isPlaying() && !player->isPaused();
+      });
     }
+    player->close();
   }
 
   LOG_INFO("This media playlist is over");
@@ -0,0 +1,148 @@
+#include "xplayer/AudioTempo.h"
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+extern "C" {
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/opt.h>
+}
+
+#include "xplayer/Log.h"
+
+std::shared_ptr<AudioTempo> AudioTempo::create() {
+  return std::make_shared<AudioTempo>();
+}
+
+AudioTempo::~AudioTempo() { release(); }
+
+bool AudioTempo::init(const AVFrame *frame, AVRational timeBase,
+                      double tempo) {
+  // the atempo chain never reaches 0, infinity or NaN
+  if (!std::isfinite(tempo) || tempo <= 0.0) {
+    LOG_ERROR("[AudioTempo] Invalid tempo {}", tempo);
+    return false;
+  }
+  if (!isDirty(frame, timeBase, tempo)) return true;
+
+  release();
+  tempo_ = tempo;
+  time_base_ = timeBase;
+  sample_rate_ = frame->sample_rate;
+  channels_ = frame->channels;
+  channel_layout_ = frame->channel_layout
+                        ? frame->channel_layout
+                        : av_get_default_channel_layout(frame->channels);
+  format_ = (AVSampleFormat)frame->format;
+  reset();
+  if (tempo_ == 1.0) return true;
+
+  if (!build()) {
+    LOG_ERROR("[AudioTempo] Failed to build the graph for tempo {}", tempo_);
+    release();
+    return false;
+  }
+  return true;
+}
+
+bool AudioTempo::build() {
+  graph_ = avfilter_graph_alloc();
+  if (!graph_) return false;
+
+  char args[256];
+  snprintf(args, sizeof(args),
+           "time_base=1/%d:sample_rate=%d:sample_fmt=%s:"
+           "channel_layout=0x%" PRIx64,
+           sample_rate_, sample_rate_, av_get_sample_fmt_name(format_),
+           channel_layout_);
+  if (avfilter_graph_create_filter(&source_, avfilter_get_by_name("abuffer"),
+                                   "in", args, nullptr, graph_) < 0)
+    return false;
+  if (avfilter_graph_create_filter(&sink_, avfilter_get_by_name("abuffersink"),
+                                   "out", nullptr, nullptr, graph_) < 0)
+    return false;
+  // keep the decoded layout, only the tempo changes
+  const AVSampleFormat formats[] = {format_, AV_SAMPLE_FMT_NONE};
+  if (av_opt_set_int_list(sink_, "sample_fmts", formats, AV_SAMPLE_FMT_NONE,
+                          AV_OPT_SEARCH_CHILDREN) < 0)
+    return false;
+
+  // atempo sounds best in [0.5, 2], larger changes are chained
+  AVFilterContext *last = source_;
+  double remain = tempo_;
+  for (int i = 0; remain != 1.0; i++) {
+    double factor = remain > 2.0 ? 2.0 : remain < 0.5 ? 0.5 : remain;
+    remain /= factor;
+    AVFilterContext *atempo = nullptr;
+    std::string name = "atempo" + std::to_string(i);
+    snprintf(args, sizeof(args), "tempo=%f", factor);
+    if (avfilter_graph_create_filter(&atempo, avfilter_get_by_name("atempo"),
+                                     name.c_str(), args, nullptr, graph_) < 0 ||
+        avfilter_link(last, 0, atempo, 0) < 0)
+      return false;
+    last = atempo;
+  }
+  if (avfilter_link(last, 0, sink_, 0) < 0) return false;
+
+  return avfilter_graph_config(graph_, nullptr) >= 0;
+}
+
+bool AudioTempo::send(const AVFramePtr &pFrame) {
+  if (!graph_) return false;
+
+  if (origin_pts_ == AV_NOPTS_VALUE) {
+    int64_t ts = pFrame->best_effort_timestamp != AV_NOPTS_VALUE
+                     ? pFrame->best_effort_timestamp
+                     : pFrame->pts;
+    origin_pts_ = ts != AV_NOPTS_VALUE ? ts : 0;
+  }
+  // the graph runs on its own sample count timeline
+  pFrame->pts = in_samples_;
+  in_samples_ += pFrame->nb_samples;
+  return av_buffersrc_add_frame_flags(source_, pFrame.get(),
+                                      AV_BUFFERSRC_FLAG_KEEP_REF) >= 0;
+}
+
+bool AudioTempo::receive(AVFramePtr &pFrame) {
+  if (!graph_) return false;
+
+  pFrame = makeAVFrame();
+  if (av_buffersink_get_frame(sink_, pFrame.get()) < 0) return false;
+
+  // an output sample stands for `tempo` input samples
+  int64_t consumed = (int64_t)(out_samples_ * tempo_);
+  pFrame->pts = pFrame->best_effort_timestamp =
+      origin_pts_ + av_rescale_q(consumed, AVRational{1, sample_rate_},
+                                 time_base_);
+  out_samples_ += pFrame->nb_samples;
+  return true;
+}
+
+void AudioTempo::reset() {
+  origin_pts_ = AV_NOPTS_VALUE;
+  in_samples_ = out_samples_ = 0;
+  if (!graph_) return;
+
+  // atempo keeps a window of samples, a new graph is the only way to drop it
+  avfilter_graph_free(&graph_);
+  source_ = sink_ = nullptr;
+  if (!build()) {
+    LOG_ERROR("[AudioTempo] Failed to rebuild the graph for tempo {}", tempo_);
+    release();
+  }
+}
+
+void AudioTempo::release() {
+  if (graph_) avfilter_graph_free(&graph_);
+  source_ = sink_ = nullptr;
+}
+
+bool AudioTempo::isDirty(const AVFrame *frame, AVRational timeBase,
+                         double tempo) const {
+  return tempo != tempo_ || frame->sample_rate != sample_rate_ ||
+         frame->channels != channels_ || frame->format != format_ ||
+         av_cmp_q(timeBase, time_base_) != 0;
+}
@@ -19,9 +19,12 @@ Converter::~Converter() {
   }
 }
 
+// the context is only rebuilt when the source or the destination changes
 bool Converter::init(int srcWidth, int srcHeight, AVPixelFormat srcFormat,
                      int dstWidth, int dstHeight, AVPixelFormat dstFormat) {
-  if (!isDirty(dstWidth, dstHeight, dstFormat)) {
+  Info src{srcWidth, srcHeight, srcFormat};
+  Info dst{dstWidth, dstHeight, dstFormat};
+  if (sws_context_ && !isDirty(src, dst)) {
     return true;
   }
 
@@ -30,7 +33,12 @@ bool Converter::init(int srcWidth, int srcHeight, AVPixelFormat srcFormat,
   sws_context_ = sws_getContext(srcWidth, srcHeight,
                                      srcFormat, dstWidth, dstHeight, dstFormat,
                                      SWS_BICUBIC, nullptr, nullptr, nullptr);
-  if (!sws_context_) return false;
+  if (!sws_context_) {
+    src_ = dst_ = Info{};
+    return false;
+  }
+  src_ = src;
+  dst_ = dst;
   return true;
 }
 bool Converter::convert(AVFramePtr pInFrame, AVFramePtr &pOutFrame) {
@@ -38,7 +46,7 @@ bool Converter::convert(AVFramePtr pInFrame, AVFramePtr &pOutFrame) {
                    pInFrame->height, pOutFrame->data, pOutFrame->linesize) >= 0;
 }
 
-bool Converter::isDirty(int dstWidth, int dstHeight, AVPixelFormat dstFormat) const
+bool Converter::isDirty(const Info &src, const Info &dst) const
 {
-  return dstWidth != last_width_ || dstHeight != last_height_ || dstFormat != last_format_;
+  return src != src_ || dst != dst_;
 }
@@ -0,0 +1,136 @@
+#include "xplayer/DecoderCache.h"
+
+#include <cstring>
+
+#include "xplayer/AVClock.h"
+#include "xplayer/Log.h"
+
+std::shared_ptr<DecoderCache> DecoderCache::create() {
+  return std::make_shared<DecoderCache>();
+}
+
+DecoderCache::~DecoderCache() {
+  this->release();
+}
+
+AVCodecContext *DecoderCache::acquire(const AVCodecParameters *par) {
+  AVClock clocker;
+
+  if (codec_context_ && isCompatible(par)) {
+    avcodec_flush_buffers(codec_context_);
+    if (!isSameExtradata(par) && !updateExtradata(par)) {
+      this->release();
+      return nullptr;
+    }
+    reused_ = true;
+    last_open_us_ = clocker.elapse();
+    LOG_INFO("[DecoderCache] Reuse {} decoder in {}us",
+             avcodec_get_name(par->codec_id), last_open_us_);
+    return codec_context_;
+  }
+
+  this->release();
+  auto pDecoder = avcodec_find_decoder(par->codec_id);
+  if (!pDecoder) return nullptr;
+  codec_context_ = avcodec_alloc_context3(pDecoder);
+  params_ = avcodec_parameters_alloc();
+  if (!codec_context_ || !params_) {
+    this->release();
+    return nullptr;
+  }
+  if (avcodec_parameters_to_context(codec_context_, par) < 0 ||
+      avcodec_parameters_copy(params_, par) < 0 ||
+      avcodec_open2(codec_context_, pDecoder, nullptr) < 0) {
+    this->release();
+    return nullptr;
+  }
+  reused_ = false;
+  last_open_us_ = clocker.elapse();
+  LOG_INFO("[DecoderCache] Open {} decoder in {}us",
+           avcodec_get_name(par->codec_id), last_open_us_);
+  return codec_context_;
+}
+
+void DecoderCache::prepare(AVPacket *pkt) {
+  if (!pending_extradata_) return;
+
+  int r = av_packet_add_side_data(pkt, AV_PKT_DATA_NEW_EXTRADATA,
+                                  pending_extradata_, pending_extradata_size_);
+  if (r < 0) av_free(pending_extradata_);
+  pending_extradata_ = nullptr;
+  pending_extradata_size_ = 0;
+}
+
+void DecoderCache::flush() {
+  if (codec_context_) avcodec_flush_buffers(codec_context_);
+}
+
+void DecoderCache::release() {
+  if (codec_context_) avcodec_free_context(&codec_context_);
+  if (params_) avcodec_parameters_free(&params_);
+  av_freep(&pending_extradata_);
+  pending_extradata_size_ = 0;
+  reused_ = false;
+}
+
+// the decoder may rewrite its own fields (e.g. aligned coded size), so the
+// parameters it was opened with are compared instead of the context
+bool DecoderCache::isCompatible(const AVCodecParameters *par) const {
+  const AVCodecParameters *last = params_;
+  if (last->codec_id != par->codec_id || last->codec_type != par->codec_type ||
+      last->codec_tag != par->codec_tag || last->format != par->format ||
+      last->profile != par->profile ||
+      last->bits_per_coded_sample != par->bits_per_coded_sample) {
+    return false;
+  }
+
+  if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+    if (last->width != par->width || last->height != par->height)
+      return false;
+  } else if (par->codec_type == AVMEDIA_TYPE_AUDIO) {
+    if (last->sample_rate != par->sample_rate ||
+        last->channels != par->channels ||
+        last->channel_layout != par->channel_layout ||
+        last->block_align != par->block_align)
+      return false;
+  }
+
+  // only these decoders parse AV_PKT_DATA_NEW_EXTRADATA while running
+  if (!isSameExtradata(par)) {
+    switch (par->codec_id) {
+      case AV_CODEC_ID_H264:
+      case AV_CODEC_ID_HEVC:
+      case AV_CODEC_ID_AAC:
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+bool DecoderCache::isSameExtradata(const AVCodecParameters *par) const {
+  const AVCodecParameters *last = params_;
+  if (last->extradata_size != par->extradata_size) return false;
+  return par->extradata_size == 0 ||
+         memcmp(last->extradata, par->extradata, par->extradata_size) == 0;
+}
+
+bool DecoderCache::updateExtradata(const AVCodecParameters *par) {
+  uint8_t *pending = nullptr;
+  if (par->extradata_size > 0) {
+    pending = (uint8_t *)av_mallocz(par->extradata_size +
+                                    AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!pending) return false;
+    memcpy(pending, par->extradata, par->extradata_size);
+  }
+  if (avcodec_parameters_copy(params_, par) < 0) {
+    av_free(pending);
+    return false;
+  }
+
+  av_free(pending_extradata_);
+  pending_extradata_ = pending;
+  pending_extradata_size_ = par->extradata_size;
+  return true;
+}
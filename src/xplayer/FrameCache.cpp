@@ -0,0 +1,158 @@
+#include "xplayer/FrameCache.h"
+
+std::shared_ptr<FrameCache> FrameCache::create(size_t capacityBytes) {
+  return std::make_shared<FrameCache>(capacityBytes);
+}
+
+void FrameCache::put(const AVFramePtr &frame, int64_t pts, int64_t prevPts) {
+  if (capacity_ == 0 || pts == AV_NOPTS_VALUE) return;
+
+  Mutex::lock locker(mutex_);
+  int64_t nextPts = AV_NOPTS_VALUE;
+  auto it = frames_.find(pts);
+  if (it != frames_.end()) {
+    // decoded again after a seek, keep the known links
+    nextPts = it->second.next;
+    if (prevPts == AV_NOPTS_VALUE) prevPts = it->second.prev;
+    bytes_ -= it->second.bytes;
+    lru_.erase(it->second.lru);
+    frames_.erase(it);
+  }
+
+  lru_.push_front(pts);
+  Node node{frame, frameBytes(frame.get()), prevPts, nextPts, lru_.begin()};
+  if (prevPts != AV_NOPTS_VALUE) {
+    auto prev = frames_.find(prevPts);
+    if (prev != frames_.end()) prev->second.next = pts;
+    else node.prev = AV_NOPTS_VALUE;
+  }
+  bytes_ += node.bytes;
+  frames_.emplace(pts, std::move(node));
+  evict();
+}
+
+AVFramePtr FrameCache::find(int64_t pts) {
+  Mutex::lock locker(mutex_);
+  auto it = frames_.find(pts);
+  if (it == frames_.end()) {
+    misses_++;
+    return nullptr;
+  }
+  return hit(it);
+}
+
+AVFramePtr FrameCache::at(int64_t pts, int64_t &framePts) {
+  Mutex::lock locker(mutex_);
+  auto it = locate(pts);
+  if (it == frames_.end()) {
+    misses_++;
+    return nullptr;
+  }
+  framePts = it->first;
+  return hit(frames_.find(it->first));
+}
+
+bool FrameCache::covers(int64_t pts) const {
+  Mutex::lock locker(mutex_);
+  return locate(pts) != frames_.end();
+}
+
+AVFramePtr FrameCache::previous(int64_t pts, int64_t &prevPts) {
+  Mutex::lock locker(mutex_);
+  auto it = frames_.find(pts);
+  if (it == frames_.end() || it->second.prev == AV_NOPTS_VALUE) {
+    misses_++;
+    return nullptr;
+  }
+  auto prev = frames_.find(it->second.prev);
+  if (prev == frames_.end()) {
+    misses_++;
+    return nullptr;
+  }
+  prevPts = prev->first;
+  return hit(prev);
+}
+
+AVFramePtr FrameCache::next(int64_t pts, int64_t &nextPts) {
+  Mutex::lock locker(mutex_);
+  auto it = frames_.find(pts);
+  if (it == frames_.end() || it->second.next == AV_NOPTS_VALUE) {
+    misses_++;
+    return nullptr;
+  }
+  auto next = frames_.find(it->second.next);
+  if (next == frames_.end()) {
+    misses_++;
+    return nullptr;
+  }
+  nextPts = next->first;
+  return hit(next);
+}
+
+void FrameCache::setCapacity(size_t capacityBytes) {
+  Mutex::lock locker(mutex_);
+  capacity_ = capacityBytes;
+  evict();
+}
+
+void FrameCache::clear() {
+  Mutex::lock locker(mutex_);
+  frames_.clear();
+  lru_.clear();
+  bytes_ = 0;
+}
+
+FrameCache::Stats FrameCache::stats() const {
+  Mutex::lock locker(mutex_);
+  Stats stats;
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.frames = frames_.size();
+  stats.bytes = bytes_;
+  stats.capacity = capacity_;
+  return stats;
+}
+
+// the last frame starting at or before pts, only if its successor is known
+// to start after pts, otherwise a frame in between may be missing
+std::map<int64_t, FrameCache::Node>::const_iterator FrameCache::locate(
+    int64_t pts) const {
+  auto it = frames_.upper_bound(pts);
+  if (it == frames_.begin()) return frames_.end();
+  --it;
+  if (it->first == pts ||
+      (it->second.next != AV_NOPTS_VALUE && it->second.next > pts))
+    return it;
+  return frames_.end();
+}
+
+AVFramePtr FrameCache::hit(std::map<int64_t, Node>::iterator it) {
+  hits_++;
+  lru_.splice(lru_.begin(), lru_, it->second.lru);
+  return it->second.frame;
+}
+
+void FrameCache::evict() {
+  while (bytes_ > capacity_ && !lru_.empty()) {
+    auto it = frames_.find(lru_.back());
+    lru_.pop_back();
+    if (it == frames_.end()) continue;
+
+    bytes_ -= it->second.bytes;
+    // the neighbours lose their link to the evicted frame
+    auto prev = frames_.find(it->second.prev);
+    if (prev != frames_.end()) prev->second.next = AV_NOPTS_VALUE;
+    auto next = frames_.find(it->second.next);
+    if (next != frames_.end()) next->second.prev = AV_NOPTS_VALUE;
+    frames_.erase(it);
+  }
+}
+
+size_t FrameCache::frameBytes(const AVFrame *frame) {
+  size_t bytes = 0;
+  for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++)
+    bytes += frame->buf[i]->size;
+  for (int i = 0; i < frame->nb_extended_buf; i++)
+    bytes += frame->extended_buf[i]->size;
+  return bytes;
+}
@@ -0,0 +1,149 @@
+#include "xplayer/HeadlessAudioSink.h"
+
+#include <chrono>
+#include <cstring>
+
+#include "xplayer/Log.h"
+#include "xplayer/Tracer.h"
+
+std::shared_ptr<HeadlessAudioSink> HeadlessAudioSink::create(
+    const std::string &wavPath, bool paced) {
+  return std::make_shared<HeadlessAudioSink>(wavPath, paced);
+}
+
+HeadlessAudioSink::HeadlessAudioSink(std::string wavPath, bool paced)
+    : wav_path_(std::move(wavPath)), is_paced_(paced) {}
+HeadlessAudioSink::~HeadlessAudioSink() {
+  this->releaseAudio();
+}
+
+// takes the wanted spec as is, there is no hardware to negotiate with
+bool HeadlessAudioSink::configureAudio(const SDL_AudioSpec &wanted) {
+  if (hasAudio() && wanted.freq == spec_.freq &&
+      wanted.format == spec_.format && wanted.channels == spec_.channels &&
+      wanted.samples == spec_.samples && wanted.callback == spec_.callback &&
+      wanted.userdata == spec_.userdata)
+    return true;
+
+  this->releaseAudio();
+  if (wanted.freq <= 0 || wanted.channels <= 0 || wanted.samples == 0 ||
+      !wanted.callback) {
+    LOG_ERROR("[HeadlessAudioSink] Invalid audio spec");
+    return false;
+  }
+  spec_ = wanted;
+  spec_.silence = (spec_.format == AUDIO_U8) ? 0x80 : 0;
+  spec_.size = (Uint32)spec_.samples * spec_.channels *
+               (SDL_AUDIO_BITSIZE(spec_.format) / 8);
+  if (!wav_path_.empty() && !openWav()) return false;
+
+  consumed_samples_ = 0;
+  is_paused_ = true;
+  is_running_ = true;
+  thread_ = std::thread(&HeadlessAudioSink::run, this);
+  LOG_INFO("[HeadlessAudioSink] Audio output {}Hz/{}ch/{} samples, {}{}{}",
+           spec_.freq, spec_.channels, spec_.samples,
+           is_paced_ ? "paced" : "unpaced", wav_path_.empty() ? "" : " to ",
+           wav_path_);
+  return true;
+}
+
+void HeadlessAudioSink::pauseAudio(bool paused) {
+  Mutex::lock locker(callback_mutex_);
+  is_paused_ = paused;
+}
+
+void HeadlessAudioSink::releaseAudio() {
+  is_running_ = false;
+  if (thread_.joinable()) thread_.join();
+  closeWav();
+  SDL_memset(&spec_, 0, sizeof(spec_));
+}
+
+void HeadlessAudioSink::run() {
+  Tracer::setThreadName("audio sink");
+  std::vector<Uint8> buffer(spec_.size);
+  using Clock = std::chrono::steady_clock;
+  // the wall time consumed_samples_ is due at when paced
+  auto start = Clock::now();
+  int64_t startSamples = 0;
+  bool wasPaused = true;
+  while (is_running_) {
+    if (is_paused_) {
+      wasPaused = true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      continue;
+    }
+    if (wasPaused) {
+      start = Clock::now();
+      startSamples = consumed_samples_;
+      wasPaused = false;
+    }
+
+    int64_t pulledUS = av_gettime_relative();
+    {
+      Mutex::lock locker(callback_mutex_);
+      // paused since the check above
+      if (is_paused_) continue;
+      spec_.callback(spec_.userdata, buffer.data(), (int)buffer.size());
+    }
+    if (buffer_tap_)
+      buffer_tap_(buffer.data(), (int)buffer.size(), consumed_samples_,
+                  pulledUS);
+    consumed_samples_ += spec_.samples;
+    if (wav_)
+      wav_data_bytes_ += std::fwrite(buffer.data(), 1, buffer.size(), wav_);
+
+    if (is_paced_) {
+      int64_t due = (consumed_samples_ - startSamples) * 1000000 / spec_.freq;
+      std::this_thread::sleep_until(start + std::chrono::microseconds(due));
+    }
+  }
+}
+
+// 44 byte RIFF header, the sizes are filled in by closeWav()
+bool HeadlessAudioSink::openWav() {
+  wav_ = std::fopen(wav_path_.c_str(), "wb");
+  if (!wav_) {
+    LOG_ERROR("[HeadlessAudioSink] Could not open {}", wav_path_);
+    return false;
+  }
+  wav_data_bytes_ = 0;
+
+  uint16_t tag = SDL_AUDIO_ISFLOAT(spec_.format) ? 3 : 1;  // float or PCM
+  uint16_t channels = spec_.channels;
+  uint32_t rate = spec_.freq;
+  uint16_t bits = SDL_AUDIO_BITSIZE(spec_.format);
+  uint16_t blockAlign = channels * bits / 8;
+  uint32_t byteRate = rate * blockAlign;
+  uint32_t fmtSize = 16;
+  uint32_t unknownSize = 0;
+
+  std::fwrite("RIFF", 1, 4, wav_);
+  std::fwrite(&unknownSize, 4, 1, wav_);
+  std::fwrite("WAVEfmt ", 1, 8, wav_);
+  std::fwrite(&fmtSize, 4, 1, wav_);
+  std::fwrite(&tag, 2, 1, wav_);
+  std::fwrite(&channels, 2, 1, wav_);
+  std::fwrite(&rate, 4, 1, wav_);
+  std::fwrite(&byteRate, 4, 1, wav_);
+  std::fwrite(&blockAlign, 2, 1, wav_);
+  std::fwrite(&bits, 2, 1, wav_);
+  std::fwrite("data", 1, 4, wav_);
+  std::fwrite(&unknownSize, 4, 1, wav_);
+  return true;
+}
+
+void HeadlessAudioSink::closeWav() {
+  if (!wav_) return;
+  uint32_t dataSize = (uint32_t)wav_data_bytes_;
+  uint32_t riffSize = dataSize + 36;
+  std::fseek(wav_, 4, SEEK_SET);
+  std::fwrite(&riffSize, 4, 1, wav_);
+  std::fseek(wav_, 40, SEEK_SET);
+  std::fwrite(&dataSize, 4, 1, wav_);
+  std::fclose(wav_);
+  wav_ = nullptr;
+  LOG_INFO("[HeadlessAudioSink] Wrote {} bytes to {}", wav_data_bytes_,
+           wav_path_);
+}
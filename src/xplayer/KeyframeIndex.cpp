@@ -0,0 +1,199 @@
+#include "xplayer/KeyframeIndex.h"
+
+#include <limits.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include "xplayer/Log.h"
+
+std::shared_ptr<KeyframeIndex> KeyframeIndex::create() {
+  return std::make_shared<KeyframeIndex>();
+}
+
+void KeyframeIndex::reset(int streamIndex) {
+  Mutex::lock locker(mutex_);
+  entries_.clear();
+  stream_index_ = streamIndex;
+  indexed_until_ = -1;
+  complete_ = false;
+  interrupted_ = false;
+  dirty_ = false;
+}
+
+void KeyframeIndex::extend(int64_t pts, int64_t pos, bool isKey) {
+  if (interrupted_) return;
+
+  Mutex::lock locker(mutex_);
+  if (complete_) return;
+  // pts isn't monotonic in decode order, keyframes are
+  if (isKey && pos >= 0 && (entries_.empty() || pts > entries_.back().pts)) {
+    entries_.push_back(Entry{pts, pos});
+    dirty_ = true;
+  }
+  indexed_until_ = std::max(indexed_until_, pts);
+}
+
+void KeyframeIndex::markComplete() {
+  if (interrupted_) return;
+
+  Mutex::lock locker(mutex_);
+  if (!complete_) dirty_ = true;
+  complete_ = true;
+}
+
+void KeyframeIndex::assign(std::vector<Entry> entries) {
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &lhs, const Entry &rhs) { return lhs.pts < rhs.pts; });
+
+  Mutex::lock locker(mutex_);
+  entries_ = std::move(entries);
+  indexed_until_ = entries_.empty() ? -1 : entries_.back().pts;
+  complete_ = true;
+  dirty_ = true;
+}
+
+bool KeyframeIndex::lookup(int64_t pts, Entry &entry) const {
+  Mutex::lock locker(mutex_);
+  if (!complete_ && pts > indexed_until_) return false;
+
+  auto it = std::upper_bound(
+      entries_.begin(), entries_.end(), pts,
+      [](int64_t value, const Entry &e) { return value < e.pts; });
+  if (it == entries_.begin()) return false;
+  entry = *(--it);
+  return true;
+}
+
+bool KeyframeIndex::covers(int64_t pts) const {
+  Mutex::lock locker(mutex_);
+  return !entries_.empty() && (complete_ || pts <= indexed_until_);
+}
+
+int64_t KeyframeIndex::indexedUntil() const {
+  Mutex::lock locker(mutex_);
+  return indexed_until_;
+}
+bool KeyframeIndex::isComplete() const {
+  Mutex::lock locker(mutex_);
+  return complete_;
+}
+size_t KeyframeIndex::size() const {
+  Mutex::lock locker(mutex_);
+  return entries_.size();
+}
+
+bool KeyframeIndex::load(const std::string &url) {
+  std::string path = cachePath(url);
+  int64_t fileSize, mtime, indexSize, indexMtime;
+  if (path.empty() || !statFile(url, fileSize, mtime) ||
+      !statFile(path, indexSize, indexMtime))
+    return false;
+
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) return false;
+
+  char magic[sizeof(kMagic)];
+  int64_t header[5];  // file size, mtime, stream index, complete, until
+  uint64_t count = 0;
+  ifs.read(magic, sizeof(magic));
+  ifs.read(reinterpret_cast<char *>(header), sizeof(header));
+  ifs.read(reinterpret_cast<char *>(&count), sizeof(count));
+  // a corrupt count can't claim more entries than the file holds
+  int64_t entryBytes =
+      indexSize - (int64_t)(sizeof(magic) + sizeof(header) + sizeof(count));
+  if (!ifs || memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+      header[0] != fileSize || header[1] != mtime ||
+      header[2] != stream_index_ || entryBytes < 0 ||
+      count != (uint64_t)entryBytes / sizeof(Entry)) {
+    return false;
+  }
+
+  std::vector<Entry> entries(count);
+  ifs.read(reinterpret_cast<char *>(entries.data()), count * sizeof(Entry));
+  if (!ifs) return false;
+
+  Mutex::lock locker(mutex_);
+  entries_ = std::move(entries);
+  complete_ = header[3] != 0;
+  indexed_until_ = header[4];
+  dirty_ = false;
+  LOG_INFO("[KeyframeIndex] Loaded {} keyframes from {}", entries_.size(), path);
+  return true;
+}
+
+bool KeyframeIndex::save(const std::string &url) const {
+  int64_t fileSize, mtime;
+  if (!statFile(url, fileSize, mtime)) return false;
+
+  Mutex::lock locker(mutex_);
+  if (!dirty_ || entries_.empty()) return true;
+
+  std::string path = cachePath(url, true);
+  if (path.empty()) return false;
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  if (!ofs) {
+    LOG_WARN("[KeyframeIndex] Could not write {}", path);
+    return false;
+  }
+  int64_t header[5] = {fileSize, mtime, stream_index_, complete_,
+                       indexed_until_};
+  uint64_t count = entries_.size();
+  ofs.write(kMagic, sizeof(kMagic));
+  ofs.write(reinterpret_cast<const char *>(header), sizeof(header));
+  ofs.write(reinterpret_cast<const char *>(&count), sizeof(count));
+  ofs.write(reinterpret_cast<const char *>(entries_.data()),
+            count * sizeof(Entry));
+  if (!ofs) return false;
+
+  dirty_ = false;
+  return true;
+}
+
+// only local files are indexed, the media directory is left alone
+std::string KeyframeIndex::cachePath(const std::string &url, bool create) {
+  if (url.empty() || url.find("://") != std::string::npos) return "";
+  char absolute[PATH_MAX];
+  if (!realpath(url.c_str(), absolute)) return "";
+
+  std::string dir;
+  const char *cacheHome = std::getenv("XDG_CACHE_HOME");
+  const char *home = std::getenv("HOME");
+  if (cacheHome && cacheHome[0] == '/') {
+    dir = cacheHome;
+  } else if (home && home[0] == '/') {
+    dir = std::string(home) + "/.cache";
+    if (create) mkdir(dir.c_str(), 0700);
+  } else {
+    return "";
+  }
+  dir += "/xplayer";
+  if (create && mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+    LOG_WARN("[KeyframeIndex] Could not create {}", dir);
+    return "";
+  }
+
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char *p = absolute; *p; p++) {
+    hash ^= (unsigned char)*p;
+    hash *= 1099511628211ULL;
+  }
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.xpidx", (unsigned long long)hash);
+  return dir + name;
+}
+
+bool KeyframeIndex::statFile(const std::string &path, int64_t &size,
+                             int64_t &mtime) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+  size = st.st_size;
+  mtime = st.st_mtime;
+  return true;
+}
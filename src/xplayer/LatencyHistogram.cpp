@@ -0,0 +1,92 @@
+#include "xplayer/LatencyHistogram.h"
+
+#include <cmath>
+
+#include "xplayer/FFmpegUtil.h"
+
+LatencyHistogram::Scope::Scope(LatencyHistogram &histogram)
+    : histogram_(histogram), start_(av_gettime_relative()) {}
+LatencyHistogram::Scope::~Scope() {
+  histogram_.record(av_gettime_relative() - start_);
+}
+
+void LatencyHistogram::record(int64_t us) {
+  if (us < 0) us = 0;
+  buckets_[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(us, std::memory_order_relaxed);
+  int64_t max = max_.load(std::memory_order_relaxed);
+  while (us > max &&
+         !max_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+  }
+}
+
+void LatencyHistogram::reset() {
+  for (auto &bucket : buckets_) bucket.store(0, std::memory_order_relaxed);
+  count_ = sum_ = max_ = 0;
+}
+
+// counts may move while walking the buckets, the result is then off by the
+// samples recorded meanwhile
+int64_t LatencyHistogram::percentile(double q) const {
+  int64_t total = 0;
+  for (auto &bucket : buckets_) total += bucket.load(std::memory_order_relaxed);
+  if (total == 0) return 0;
+
+  int64_t rank = (int64_t)std::ceil(q * total);
+  if (rank < 1) rank = 1;
+  int64_t seen = 0;
+  for (int i = 0; i < kBuckets; i++) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      // a bucket is never reported above the largest recorded value
+      int64_t max = max_.load(std::memory_order_relaxed);
+      int64_t upper = bucketUpper(i);
+      return upper < max ? upper : max;
+    }
+  }
+  return max_.load(std::memory_order_relaxed);
+}
+
+LatencyHistogram::Summary LatencyHistogram::summary() const {
+  Summary summary;
+  summary.count = count();
+  if (summary.count == 0) return summary;
+  summary.total_us = sum_.load(std::memory_order_relaxed);
+  summary.mean_us = summary.total_us / summary.count;
+  summary.p50_us = percentile(0.5);
+  summary.p99_us = percentile(0.99);
+  summary.max_us = max_.load(std::memory_order_relaxed);
+  return summary;
+}
+
+// values below kSubBuckets are exact, above each power of two 2^m holds
+// kSubBuckets buckets of width 2^(m - kSubBits)
+int LatencyHistogram::bucketOf(int64_t us) {
+  if (us < kSubBuckets) return (int)us;
+  int magnitude = 63 - __builtin_clzll((unsigned long long)us);
+  if (magnitude > kMaxBits) return kBuckets - 1;
+  int shift = magnitude - kSubBits;
+  int sub = (int)((us >> shift) & (kSubBuckets - 1));
+  return (magnitude - kSubBits + 1) * kSubBuckets + sub;
+}
+
+int64_t LatencyHistogram::bucketUpper(int bucket) {
+  if (bucket < kSubBuckets) return bucket;
+  int magnitude = bucket / kSubBuckets + kSubBits - 1;
+  int sub = bucket % kSubBuckets;
+  int shift = magnitude - kSubBits;
+  return ((int64_t)(kSubBuckets + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::countsAtMost(const int64_t *boundsUS, int64_t *counts,
+                                    int n) const {
+  int64_t sum = 0;
+  int bucket = 0;
+  for (int i = 0; i < n; i++) {
+    int last = bucketOf(FFMAX(boundsUS[i], 0));
+    for (; bucket <= last; bucket++)
+      sum += buckets_[bucket].load(std::memory_order_relaxed);
+    counts[i] = sum;
+  }
+}
@@ -0,0 +1,148 @@
+#include "xplayer/Log.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+std::atomic<int> Logger::level_{LDEBUG};
+
+// never destroyed, so objects logging from their destructors at exit find
+// it alive, stop() writes out what is left instead
+Logger &Logger::instance() {
+  static Logger *logger = [] {
+    auto *logger = new Logger();
+    std::atexit([] { Logger::instance().stop(); });
+    return logger;
+  }();
+  return *logger;
+}
+
+Logger::Logger() : head_(&stub_), tail_(&stub_) {
+  writer_ = std::thread(&Logger::run, this);
+}
+
+fmt::memory_buffer &Logger::threadBuffer() {
+  thread_local fmt::memory_buffer buffer;
+  return buffer;
+}
+
+void Logger::flush() {
+  Mutex::lock locker(consumer_mutex_);
+  drain();
+}
+
+void Logger::stop() {
+  if (stopped_.exchange(true)) return;
+  wake_.notify_one();
+  if (writer_.joinable()) writer_.join();
+  flush();
+}
+
+void Logger::push(LogLevel level, const char *text, size_t size) {
+  void *memory = ::operator new(sizeof(Record) + size);
+  Record *record = new (memory) Record();
+  record->level = level;
+  record->time = time(nullptr);
+  record->size = size;
+  memcpy(record->text(), text, size);
+
+  record->next.store(nullptr, std::memory_order_relaxed);
+  Record *prev = head_.exchange(record, std::memory_order_acq_rel);
+  prev->next.store(record, std::memory_order_release);
+
+  if (stopped_ || level >= LFATAL)
+    flush();
+  else if (level >= LERROR)
+    wake_.notify_one();
+}
+
+// nullptr when empty or while a producer is between its two steps
+Logger::Record *Logger::pop() {
+  Record *tail = tail_;
+  Record *next = tail->next.load(std::memory_order_acquire);
+  if (tail == &stub_) {
+    if (!next) return nullptr;
+    tail_ = next;
+    tail = next;
+    next = next->next.load(std::memory_order_acquire);
+  }
+  if (next) {
+    tail_ = next;
+    return tail;
+  }
+  if (tail != head_.load(std::memory_order_acquire)) return nullptr;
+
+  // tail is the last record, put the stub behind it to take it out
+  stub_.next.store(nullptr, std::memory_order_relaxed);
+  Record *prev = head_.exchange(&stub_, std::memory_order_acq_rel);
+  prev->next.store(&stub_, std::memory_order_release);
+  next = tail->next.load(std::memory_order_acquire);
+  if (next) {
+    tail_ = next;
+    return tail;
+  }
+  return nullptr;
+}
+
+void Logger::run() {
+  while (!stopped_) {
+    {
+      Mutex::ulock locker(wake_mutex_);
+      wake_.wait_for(locker, std::chrono::milliseconds(kWriterIntervalMS));
+    }
+    flush();
+  }
+}
+
+void Logger::drain() {
+  thread_local fmt::memory_buffer out;
+  out.clear();
+  while (Record *record = pop()) {
+    write(out, record);
+    record->~Record();
+    ::operator delete(record);
+  }
+  if (out.size() == 0) return;
+  fwrite(out.data(), 1, out.size(), stdout);
+  fflush(stdout);
+}
+
+void Logger::write(fmt::memory_buffer &out, Record *record) {
+  const char *prefix;
+  switch (record->level) {
+    case LDEBUG:
+      prefix = "\033[34m[DEBUG]\t";
+      break;
+    case LINFO:
+      prefix = "\033[32m[INFO]\t";
+      break;
+    case LWARN:
+      prefix = "\033[33m[WARN]\t";
+      break;
+    case LERROR:
+      prefix = "\033[31;1m[ERROR]\t";
+      break;
+    case LFATAL:
+      prefix = "\033[31;2m[FATAL]\t";
+      break;
+    default:
+      prefix = "[UNKNOWN]\t";
+      break;
+  }
+
+  if (record->time != stamp_time_) {
+    struct tm tm;
+    localtime_r(&record->time, &tm);
+    strftime(stamp_, sizeof(stamp_), "%Y-%m-%d %H:%M:%S", &tm);
+    stamp_time_ = record->time;
+  }
+
+  out.append(prefix, prefix + strlen(prefix));
+  out.append(stamp_, stamp_ + strlen(stamp_));
+  out.push_back('\t');
+  out.append(record->text(), record->text() + record->size);
+  static constexpr char kSuffix[] = "\033[0m\n";
+  out.append(kSuffix, kSuffix + sizeof(kSuffix) - 1);
+}
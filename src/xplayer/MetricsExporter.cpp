@@ -0,0 +1,162 @@
+#include "xplayer/MetricsExporter.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "xplayer/Log.h"
+#include "xplayer/Tracer.h"
+
+std::shared_ptr<MetricsExporter> MetricsExporter::create() {
+  return std::make_shared<MetricsExporter>();
+}
+
+MetricsExporter::~MetricsExporter() { stop(); }
+
+bool MetricsExporter::start(int port, const std::string &unixPath,
+                            Collector collector) {
+  stop();
+  if (unixPath.empty()) {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) return false;
+    int reuse = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    // never reachable from other hosts
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t)port);
+    socklen_t len = sizeof(addr);
+    if (bind(listen_fd_, (sockaddr *)&addr, len) < 0 ||
+        getsockname(listen_fd_, (sockaddr *)&addr, &len) < 0) {
+      LOG_ERROR("[MetricsExporter] Could not bind 127.0.0.1:{}: {}", port,
+                std::strerror(errno));
+      stop();
+      return false;
+    }
+    port_ = ntohs(addr.sin_port);
+  } else {
+    sockaddr_un addr{};
+    if (unixPath.size() >= sizeof(addr.sun_path)) {
+      LOG_ERROR("[MetricsExporter] Socket path too long: {}", unixPath);
+      return false;
+    }
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) return false;
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, unixPath.c_str(), sizeof(addr.sun_path) - 1);
+    // a socket left behind by a killed player
+    unlink(unixPath.c_str());
+    if (bind(listen_fd_, (sockaddr *)&addr, sizeof(addr)) < 0) {
+      LOG_ERROR("[MetricsExporter] Could not bind {}: {}", unixPath,
+                std::strerror(errno));
+      stop();
+      return false;
+    }
+    unix_path_ = unixPath;
+    port_ = 0;
+  }
+  if (listen(listen_fd_, 8) < 0 || pipe(wake_fds_) < 0) {
+    LOG_ERROR("[MetricsExporter] Could not listen: {}", std::strerror(errno));
+    stop();
+    return false;
+  }
+
+  collector_ = std::move(collector);
+  thread_ = std::thread(&MetricsExporter::run, this);
+  if (unix_path_.empty())
+    LOG_INFO("[MetricsExporter] Serving http://127.0.0.1:{}/metrics", port_);
+  else
+    LOG_INFO("[MetricsExporter] Serving /metrics on {}", unix_path_);
+  return true;
+}
+
+void MetricsExporter::stop() {
+  if (thread_.joinable()) {
+    char byte = 0;
+    if (write(wake_fds_[1], &byte, 1) < 0)
+      LOG_WARN("[MetricsExporter] Could not wake the server thread");
+    thread_.join();
+  }
+  for (int *fd : {&listen_fd_, &wake_fds_[0], &wake_fds_[1]}) {
+    if (*fd >= 0) close(*fd);
+    *fd = -1;
+  }
+  if (!unix_path_.empty()) unlink(unix_path_.c_str());
+  unix_path_.clear();
+}
+
+void MetricsExporter::run() {
+  Tracer::setThreadName("metrics");
+  pollfd fds[2] = {{listen_fd_, POLLIN, 0}, {wake_fds_[0], POLLIN, 0}};
+  while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      LOG_ERROR("[MetricsExporter] poll failed: {}", std::strerror(errno));
+      return;
+    }
+    if (fds[1].revents) return;
+    if (!(fds[0].revents & POLLIN)) continue;
+    int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) continue;
+    serve(fd);
+    close(fd);
+  }
+}
+
+// HTTP/1.0 style: one request per connection, closed after the response
+void MetricsExporter::serve(int fd) {
+  timeval timeout{kIOTimeoutMS / 1000, (kIOTimeoutMS % 1000) * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  std::string request;
+  char buffer[1024];
+  while (request.find("\r\n\r\n") == std::string::npos &&
+         request.size() < kMaxRequestBytes) {
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n <= 0) break;
+    request.append(buffer, (size_t)n);
+  }
+  size_t lineEnd = request.find("\r\n");
+  if (lineEnd == std::string::npos) return;
+
+  std::string line = request.substr(0, lineEnd);
+  bool isGet = line.compare(0, 4, "GET ") == 0;
+  size_t pathEnd = line.find(' ', 4);
+  std::string path = isGet ? line.substr(4, pathEnd - 4) : std::string();
+  std::string status, contentType, body;
+  if (!isGet) {
+    status = "405 Method Not Allowed";
+    contentType = "text/plain";
+    body = "only GET\n";
+  } else if (path == "/metrics" || path.compare(0, 9, "/metrics?") == 0) {
+    status = "200 OK";
+    contentType = "text/plain; version=0.0.4; charset=utf-8";
+    body = collector_ ? collector_() : std::string();
+    scrapes_++;
+  } else {
+    status = "404 Not Found";
+    contentType = "text/plain";
+    body = "see /metrics\n";
+  }
+
+  std::string response = fmt::format(
+      "HTTP/1.1 {}\r\nContent-Type: {}\r\nContent-Length: {}\r\n"
+      "Connection: close\r\n\r\n{}",
+      status, contentType, body.size(), body);
+  size_t sent = 0;
+  while (sent < response.size()) {
+    ssize_t n = send(fd, response.data() + sent, response.size() - sent,
+                     MSG_NOSIGNAL);
+    if (n <= 0) break;
+    sent += (size_t)n;
+  }
+}
@@ -0,0 +1,62 @@
+#include "xplayer/NullVideoSink.h"
+
+extern "C" {
+#include <libavutil/adler32.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "xplayer/Log.h"
+
+std::shared_ptr<NullVideoSink> NullVideoSink::create(bool checksum) {
+  return std::make_shared<NullVideoSink>(checksum);
+}
+
+bool NullVideoSink::configureVideo(const Spec &spec) {
+  is_configured_ = true;
+  LOG_INFO("[NullVideoSink] Video output {}x{}{}", spec.width, spec.height,
+           is_checksum_ ? " with checksums" : "");
+  return true;
+}
+
+bool NullVideoSink::updateVideo(const AVFrame *frame) {
+  frames_++;
+  pending_ = frame;
+  if (!is_checksum_) return true;
+
+  // the padding at the end of a row isn't part of the picture
+  auto format = (AVPixelFormat)frame->format;
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+  if (!desc) return false;
+  uint32_t adler = 1;
+  for (int plane = 0; plane < AV_NUM_DATA_POINTERS && frame->data[plane];
+       plane++) {
+    int rowBytes = av_image_get_linesize(format, frame->width, plane);
+    if (rowBytes <= 0) break;
+    bool isChroma = (plane == 1 || plane == 2) &&
+                    !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+    int rows = isChroma ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h)
+                        : frame->height;
+    for (int y = 0; y < rows; y++)
+      adler = av_adler32_update(
+          adler, frame->data[plane] + (ptrdiff_t)y * frame->linesize[plane],
+          rowBytes);
+  }
+  last_checksum_ = adler;
+  // order dependent, a dropped or swapped picture changes it
+  uint32_t total = checksum_;
+  checksum_ = av_adler32_update(total, reinterpret_cast<const uint8_t *>(&adler),
+                                sizeof(adler));
+  return true;
+}
+
+// the frame passed to updateVideo() is alive until this returns
+void NullVideoSink::presentVideo() {
+  presented_++;
+  if (present_tap_ && pending_) present_tap_(pending_, av_gettime_relative());
+  pending_ = nullptr;
+}
+
+void NullVideoSink::resetCounters() {
+  frames_ = presented_ = 0;
+  checksum_ = last_checksum_ = 1;
+}
@@ -15,23 +15,19 @@ std::shared_ptr<Resampler> Resampler::create(int srcChannels,
 
 Resampler::Resampler() {}
 Resampler::~Resampler() {
-  if (swr_is_initialized(swr_context_)) {
-    swr_free(&swr_context_);
-    swr_context_ = nullptr;
-  }
+  if (swr_context_) swr_free(&swr_context_);
 }
 
 bool Resampler::init(int srcChannels, AVSampleFormat srcFormat,
                      int srcSampleRate, int dstChannels,
                      AVSampleFormat dstFormat, int dstSampleRate) {
-  if (!isDirty(srcChannels, srcFormat, srcSampleRate) && !swr_context_) {
+  Info src{srcChannels, srcFormat, srcSampleRate};
+  Info dst{dstChannels, dstFormat, dstSampleRate};
+  if (swr_context_ && !isDirty(src, dst)) {
     return true;
   }
 
-  if (swr_context_ && swr_is_initialized(swr_context_)) {
-    swr_free(&swr_context_);
-    swr_context_ = nullptr;
-  }
+  if (swr_context_) swr_free(&swr_context_);
 
   int r{-1};
   swr_context_ = swr_alloc_set_opts(
@@ -46,9 +42,8 @@ bool Resampler::init(int srcChannels, AVSampleFormat srcFormat,
     swr_context_ = nullptr;
     return false;
   }
-  last_channels_ = srcChannels;
-  last_format_ = srcFormat;
-  last_sample_rate_ = srcSampleRate;
+  src_ = src;
+  dst_ = dst;
   return true;
 }
 
@@ -72,11 +67,21 @@ bool Resampler::resample(AVFramePtr pInFrame, AVFramePtr &pOutFrame) {
   // }
 
   // return len * pOutFrame->channels * av_get_bytes_per_sample((AVSampleFormat)pOutFrame->format);
-  return swr_convert_frame(swr_context_, pOutFrame.get(), pInFrame.get()) == 0;
+  if (!swr_context_) return false;
+
+  // the context was set up with the default layouts of the channel counts
+  pInFrame->channel_layout = av_get_default_channel_layout(src_.channels);
+  pOutFrame->format = dst_.format;
+  pOutFrame->sample_rate = dst_.sample_rate;
+  pOutFrame->channels = dst_.channels;
+  pOutFrame->channel_layout = av_get_default_channel_layout(dst_.channels);
+  if (swr_convert_frame(swr_context_, pOutFrame.get(), pInFrame.get()) != 0)
+    return false;
+  pOutFrame->pts = pInFrame->pts;
+  pOutFrame->best_effort_timestamp = pInFrame->best_effort_timestamp;
+  return true;
 }
 
-bool Resampler::isDirty(int dstChannels, AVSampleFormat dstFormat,
-                        int dstSampleRate) const {
-  return last_channels_ != dstChannels || last_format_ != dstFormat ||
-         last_sample_rate_ != dstSampleRate;
+bool Resampler::isDirty(const Info &src, const Info &dst) const {
+  return src != src_ || dst != dst_;
 }
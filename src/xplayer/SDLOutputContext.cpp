@@ -0,0 +1,191 @@
+#include "xplayer/SDLOutputContext.h"
+
+#include "xplayer/AVClock.h"
+#include "xplayer/Log.h"
+
+std::shared_ptr<SDLOutputContext> SDLOutputContext::create() {
+  return std::make_shared<SDLOutputContext>();
+}
+
+SDLOutputContext::SDLOutputContext() {}
+SDLOutputContext::~SDLOutputContext() {
+  this->release();
+}
+
+bool SDLOutputContext::configureVideo(const VideoSpec &spec) {
+  AVClock clocker;
+  const char *transition = "reuse";
+
+  if (!window_) {
+    window_ = SDL_CreateWindow(spec.title.c_str(), spec.xleft, spec.ytop,
+                               spec.width, spec.height, 0);
+    if (!window_) {
+      LOG_ERROR("[SDLOutputContext] Could not create window! SDL_ERROR: {}",
+                SDL_GetError());
+      return false;
+    }
+    transition = "create";
+  } else {
+    if (spec.width != video_spec_.width || spec.height != video_spec_.height) {
+      SDL_SetWindowSize(window_, spec.width, spec.height);
+      transition = "resize";
+    }
+    if (spec.xleft != video_spec_.xleft || spec.ytop != video_spec_.ytop)
+      SDL_SetWindowPosition(window_, spec.xleft, spec.ytop);
+    if (spec.title != video_spec_.title)
+      SDL_SetWindowTitle(window_, spec.title.c_str());
+  }
+
+  if (!renderer_) {
+    renderer_ = SDL_CreateRenderer(window_, -1, SDL_RENDERER_ACCELERATED);
+    if (!renderer_) {
+      LOG_ERROR("[SDLOutputContext] Could not create renderer! SDL_ERROR: {}",
+                SDL_GetError());
+      this->releaseVideo();
+      return false;
+    }
+  }
+  video_spec_ = spec;
+
+  last_video_setup_us_ = clocker.elapse();
+  LOG_INFO("[SDLOutputContext] Video output {} {}x{} in {}us", transition,
+           spec.width, spec.height, last_video_setup_us_);
+  return true;
+}
+
+bool SDLOutputContext::configureAudio(const SDL_AudioSpec &wanted) {
+  AVClock clocker;
+  const char *transition = "reuse";
+
+  if (audio_device_id_ <= 0 || !isSameAudioSpec(wanted, wanted_)) {
+    transition = audio_device_id_ > 0 ? "reopen" : "create";
+    this->releaseAudio();
+
+    audio_device_id_ = SDL_OpenAudioDevice(
+        nullptr, false, &wanted, &obtained_,
+        SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE |
+            SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+    if (audio_device_id_ <= 0) {
+      LOG_ERROR("[SDLOutputContext] Failed to open audio device! SDL_ERROR: {}",
+                SDL_GetError());
+      audio_device_id_ = 0;
+      return false;
+    }
+    wanted_ = wanted;
+  }
+
+  last_audio_setup_us_ = clocker.elapse();
+  LOG_INFO("[SDLOutputContext] Audio output {} {}Hz/{}ch/{} samples in {}us",
+           transition, obtained_.freq, obtained_.channels, obtained_.samples,
+           last_audio_setup_us_);
+  return true;
+}
+
+bool SDLOutputContext::updateVideo(const AVFrame *frame) {
+  SDL_PixelFormatEnum format = pixelFormatOf((AVPixelFormat)frame->format);
+  SDL_Texture *pTexture = texture(format, frame->width, frame->height);
+  if (pTexture == nullptr) {
+    LOG_ERROR("[SDLOutputContext] Failed to create texture! SDL_ERROR: {}",
+              SDL_GetError());
+    return false;
+  }
+
+  if (format == SDL_PIXELFORMAT_YV12 || format == SDL_PIXELFORMAT_IYUV)
+    SDL_UpdateYUVTexture(pTexture, nullptr, frame->data[0], frame->linesize[0],
+                         frame->data[1], frame->linesize[1], frame->data[2],
+                         frame->linesize[2]);
+  else
+    SDL_UpdateTexture(pTexture, nullptr, frame->data[0], frame->linesize[0]);
+  return true;
+}
+
+void SDLOutputContext::presentVideo() {
+  if (!renderer_ || !texture_) return;
+  SDL_RenderClear(renderer_);
+  SDL_RenderCopy(renderer_, texture_, nullptr, nullptr);
+  SDL_RenderPresent(renderer_);
+}
+
+void SDLOutputContext::pauseAudio(bool paused) {
+  if (audio_device_id_ <= 0) return;
+  SDL_LockAudioDevice(audio_device_id_);
+  SDL_PauseAudioDevice(audio_device_id_, paused ? 1 : 0);
+  SDL_UnlockAudioDevice(audio_device_id_);
+}
+
+SDL_Texture *SDLOutputContext::texture(Uint32 format, int width, int height) {
+  if (!renderer_) return nullptr;
+  if (texture_ && texture_format_ == format && texture_width_ == width &&
+      texture_height_ == height) {
+    return texture_;
+  }
+
+  if (texture_) SDL_DestroyTexture(texture_);
+  texture_ = SDL_CreateTexture(renderer_, format, SDL_TEXTUREACCESS_STREAMING,
+                               width, height);
+  if (!texture_) return nullptr;
+  texture_format_ = format;
+  texture_width_ = width;
+  texture_height_ = height;
+  return texture_;
+}
+
+void SDLOutputContext::releaseVideo() {
+  if (texture_) SDL_DestroyTexture(texture_);
+  if (renderer_) SDL_DestroyRenderer(renderer_);
+  if (window_) SDL_DestroyWindow(window_);
+  texture_ = nullptr;
+  renderer_ = nullptr;
+  window_ = nullptr;
+  texture_format_ = 0;
+  texture_width_ = texture_height_ = 0;
+  video_spec_ = VideoSpec{};
+}
+
+void SDLOutputContext::releaseAudio() {
+  if (audio_device_id_ > 0) {
+    SDL_PauseAudioDevice(audio_device_id_, 1);
+    SDL_CloseAudioDevice(audio_device_id_);
+  }
+  audio_device_id_ = 0;
+  SDL_memset(&wanted_, 0, sizeof(wanted_));
+  SDL_memset(&obtained_, 0, sizeof(obtained_));
+}
+
+void SDLOutputContext::release() {
+  this->releaseAudio();
+  this->releaseVideo();
+}
+
+bool SDLOutputContext::isSameAudioSpec(const SDL_AudioSpec &lhs,
+                                       const SDL_AudioSpec &rhs) {
+  return lhs.freq == rhs.freq && lhs.format == rhs.format &&
+         lhs.channels == rhs.channels && lhs.samples == rhs.samples &&
+         lhs.callback == rhs.callback && lhs.userdata == rhs.userdata;
+}
+
+SDL_PixelFormatEnum SDLOutputContext::pixelFormatOf(AVPixelFormat format) {
+  switch (format) {
+    case AV_PIX_FMT_YUVJ420P:
+    case AV_PIX_FMT_YUV420P:
+      return SDL_PIXELFORMAT_YV12;
+    case AV_PIX_FMT_YUV422P:
+      return SDL_PIXELFORMAT_YUY2;
+    case AV_PIX_FMT_YUV444P:
+      return SDL_PIXELFORMAT_IYUV;
+    case AV_PIX_FMT_RGB24:
+      return SDL_PIXELFORMAT_RGB24;
+    case AV_PIX_FMT_BGR24:
+      return SDL_PIXELFORMAT_BGR24;
+    case AV_PIX_FMT_RGBA:
+      return SDL_PIXELFORMAT_RGBA32;
+    case AV_PIX_FMT_BGRA:
+      return SDL_PIXELFORMAT_BGRA32;
+    case AV_PIX_FMT_ARGB:
+      return SDL_PIXELFORMAT_ARGB32;
+    case AV_PIX_FMT_ABGR:
+      return SDL_PIXELFORMAT_ABGR32;
+    default:
+      return SDL_PIXELFORMAT_UNKNOWN;
+  }
+}
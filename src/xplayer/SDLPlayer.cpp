@@ -5,10 +5,17 @@
 
 #include <SDL2/SDL_events.h>
 #include <SDL2/SDL_timer.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
+#include <deque>
 #include <memory>
 #include <sstream>
 
@@ -33,9 +40,19 @@ SDLPlayer::SDLPlayer() : Player() {
   SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO);
   converter_ = std::make_shared<Converter>();
   resampler_ = std::make_shared<Resampler>();
+  audio_tempo_ = AudioTempo::create();
+  output_ = SDLOutputContext::create();
+  keyframe_index_ = KeyframeIndex::create();
+  frame_cache_ = FrameCache::create(0);
+  audio_decoder_ = DecoderCache::create();
+  video_decoder_ = DecoderCache::create();
+  metrics_exporter_ = MetricsExporter::create();
 }
 
 SDLPlayer::~SDLPlayer() {
+  // it reads the members from its own thread
+  metrics_exporter_->stop();
+  open_thread_.join();
   // if (status_ != Player::INITED && status_ != Player::NONE)
   //   this->destroy();
   SDL_Quit();
@@ -45,32 +62,121 @@ bool SDLPlayer::init(PlayerConfig config) {
   if (!checkConfig()) return false;
 
   config_ = config;
-  status_ = Player::INITED;
+  speed_ = config_.common.speed;
+  if (config_.trace.enabled && !Tracer::enabled())
+    Tracer::instance().start(config_.trace.path,
+                             (size_t)FFMAX(config_.trace.events_per_thread, 1));
+  // stays up across files, a failure doesn't stop playback
+  if (config_.metrics.enabled && !metrics_exporter_->isRunning())
+    metrics_exporter_->start(config_.metrics.port, config_.metrics.unix_socket,
+                             [this] { return metrics(); });
+  frame_cache_->setCapacity((size_t)FFMAX(config_.video.frame_cache_mb, 0)
+                            << 20);
+  if (config_.output.headless || config_.common.unpaced)
+    setSinks(NullVideoSink::create(config_.output.checksum),
+             HeadlessAudioSink::create(
+                 config_.output.wav_path,
+                 config_.output.paced && !config_.common.unpaced));
+  else
+    setSinks(output_, output_);
+  setStatus(Player::INITED);
   return true;
 }
 
 void SDLPlayer::destroy() {
   ASSERT(status_ != Player::NONE);
 
+  open_thread_.join();
   this->close();
+  audio_decoder_->release();
+  video_decoder_->release();
   // SDL
-  if (renderer_) SDL_DestroyRenderer(renderer_);
-  if (window_) SDL_DestroyWindow(window_);
+  audio_sink_->releaseAudio();
+  video_sink_->releaseVideo();
+  output_->release();
 
-  status_ = Player::INITED;
+  setStatus(Player::INITED);
 }
 
 // call this function after initialization or a file(url) is finished
 bool SDLPlayer::openUrl(const std::string &url) {
-  status_ = Player::OPENING;
+  is_over_ = false;
+  if (!openInput(url) || !openOutput()) {
+    setStatus(Player::BROKEN);
+    return false;
+  }
+
+  if (config_.play_after_ready) {
+    return play();
+  }
+  return true;
+}
+std::future<bool> SDLPlayer::openUrlAsync(const std::string &url) {
+  auto pPromise = std::make_shared<std::promise<bool>>();
+  auto future = pPromise->get_future();
+  openUrlAsync(url, [pPromise](bool success) { pPromise->set_value(success); });
+  return future;
+}
+// the SDL output is configured by play() on the thread that renders
+void SDLPlayer::openUrlAsync(const std::string &url, OpenCallback callback) {
+  // the open thread can't join itself, it takes the request once the
+  // callback returned
+  if (open_thread_.isCurrent()) {
+    Mutex::lock locker(open_mutex_);
+    pending_opens_.emplace_back(url, std::move(callback));
+    return;
+  }
+  open_thread_.join();
+  // close() aborts the open through it from here on
+  is_over_ = false;
+  open_thread_.dispatch([this, url, callback] {
+    std::pair<std::string, OpenCallback> request{url, callback};
+    while (true) {
+      bool success = openInput(request.first);
+      if (!success) setStatus(Player::BROKEN);
+      if (request.second) request.second(success);
+
+      Mutex::lock locker(open_mutex_);
+      if (pending_opens_.empty()) break;
+      request = std::move(pending_opens_.front());
+      pending_opens_.pop_front();
+      // a failed open closed the player, the next one starts over
+      is_over_ = false;
+    }
+  });
+}
+
+// probes the input, opens the decoders and starts the read/decode threads
+bool SDLPlayer::openInput(const std::string &url) {
+  setStatus(Player::OPENING);
+  AVClock openClocker;
 
   int r{-1};
   format_context_ = avformat_alloc_context();
-  avformat_open_input(&format_context_, url.c_str(), nullptr, nullptr);
+  // lets close() or a stalled input abort any blocking I/O call
+  format_context_->interrupt_callback.callback = SDLPlayer::interruptCallback;
+  format_context_->interrupt_callback.opaque = this;
+  // a FIFO blocks in open() and read() where the callback can't reach, it
+  // is read non-blocking through the pipe protocol instead
+  std::string input = url;
+  struct stat st;
+  if (stat(url.c_str(), &st) == 0 && S_ISFIFO(st.st_mode)) {
+    fifo_fd_ = ::open(url.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fifo_fd_ >= 0) input = fmt::format("pipe:{}", fifo_fd_);
+  }
+  setIODeadline(config_.io.open_timeout_ms);
+  r = avformat_open_input(&format_context_, input.c_str(), nullptr, nullptr);
+  if (r < 0) {
+    setIODeadline(0);
+    LOG_ERROR("[SDLPlayer] Failed to open {}: {}", url, errorString(r));
+    this->close();
+    return false;
+  }
   r = avformat_find_stream_info(format_context_, nullptr);
+  setIODeadline(0);
   if (r < 0) {
     LOG_ERROR("[SDLPlayer] Failed to find stream info while opening {}", url);
-    this->destroy();
+    this->close();
     return false;
   }
 
@@ -105,46 +211,35 @@ bool SDLPlayer::openUrl(const std::string &url) {
   if (!enable_audio_ && !enable_video_) {
     LOG_ERROR("[SDLPlayer] No audio or video stream found while opening {}",
               url);
-    this->destroy();
+    this->close();
     return false;
   }
+  if (!enable_audio_) audio_stream_index_ = -1;
+  if (!enable_video_) video_stream_index_ = -1;
+  // the demuxer skips everything we don't play
+  applyStreamDiscard();
+
+  if (config_.common.keyframe_index && enable_video_) {
+    keyframe_index_->reset(video_stream_index_);
+    keyframe_index_->load(url);
+    if (config_.common.keyframe_index_scan && !keyframe_index_->isComplete())
+      index_thread_.dispatch(&SDLPlayer::onScanKeyframes, this, url,
+                             (int)video_stream_index_);
+  }
+  else {
+    keyframe_index_->reset(-1);
+  }
 
   if (enable_audio_) {
+    // reuses the previous item's decoder when the parameters match
     auto pAudioParam = format_context_->streams[audio_stream_index_]->codecpar;
-    auto pAudioDecoder = avcodec_find_decoder(pAudioParam->codec_id);
-    audio_codec_context_ = avcodec_alloc_context3(pAudioDecoder);
-    avcodec_parameters_to_context(audio_codec_context_, pAudioParam);
-    r = avcodec_open2(audio_codec_context_, pAudioDecoder, nullptr);
-    if (r < 0) {
+    audio_codec_context_ = audio_decoder_->acquire(pAudioParam);
+    if (!audio_codec_context_) {
       LOG_ERROR("[SDLPlayer] Failed to open audio codec while opening {}", url);
-      this->destroy();
-      return false;
-    }
-
-    SDL_AudioSpec wanted, obtained;
-    SDL_memset(&wanted, 0, sizeof(wanted));
-    wanted.freq = config_.audio.sample_rate;
-    wanted.format = convertFFmpegSampleFormatToSDLSampleFormat(
-        (AVSampleFormat)config_.audio.format);
-    wanted.channels = config_.audio.channels;
-    wanted.samples = 1024;
-    wanted.callback = SDLPlayer::sdlAudioCallback;
-    wanted.userdata = this;
-
-    int num = SDL_GetNumAudioDevices(false);
-    for (int i = 0; i < num; i++) {
-      const char *name = SDL_GetAudioDeviceName(i, false);
-      audio_device_id_ =
-          SDL_OpenAudioDevice(nullptr, false, &wanted, &obtained, 0);
-      if (audio_device_id_ > 0) break;
-    }
-    if (audio_device_id_ <= 0) {
-      LOG_ERROR("[SDLPlayer] Failed to open audio device");
-      this->destroy();
+      this->close();
       return false;
     }
 
-    audio_buffer_.reset(new AVAudioBuffer{kMaxAudioBufferSize});
     audio_packet_queue_.open();
   }
 
@@ -153,13 +248,10 @@ bool SDLPlayer::openUrl(const std::string &url) {
 
   if (enable_video_) {
     auto pVideoParam = format_context_->streams[video_stream_index_]->codecpar;
-    auto pVideoDecoder = avcodec_find_decoder(pVideoParam->codec_id);
-    video_codec_context_ = avcodec_alloc_context3(pVideoDecoder);
-    avcodec_parameters_to_context(video_codec_context_, pVideoParam);
-    r = avcodec_open2(video_codec_context_, pVideoDecoder, nullptr);
-    if (r < 0) {
+    video_codec_context_ = video_decoder_->acquire(pVideoParam);
+    if (!video_codec_context_) {
       LOG_ERROR("[SDLPlayer] Failed to open video codec while opening {}", url);
-      this->destroy();
+      this->close();
       return false;
     }
 
@@ -189,33 +281,32 @@ bool SDLPlayer::openUrl(const std::string &url) {
       exit(1);
     }
 
-    window_ =
-        SDL_CreateWindow(url_.c_str(), config_.video.xleft, config_.video.ytop,
-                         config_.video.width, config_.video.height, 0);
-    if (!window_) {
-      LOG_ERROR("[SDLPlayer] Could not create window! SDL_ERROR: {}",
-                SDL_GetError());
-      this->destroy();
-      return false;
-    }
-    renderer_ = SDL_CreateRenderer(window_, -1, SDL_RENDERER_ACCELERATED);
-    if (!renderer_) {
-      LOG_ERROR("[SDLPlayer] Could not create renderer! SDL_ERROR: {}",
-                SDL_GetError());
-      this->destroy();
-      return false;
-    }
-
     video_packet_queue_.open();
   }
 
-  LOG_INFO("[SDLPlayer] Loading video {}, length: {}", url, getTotalTime());
+  last_open_us_ = openClocker.elapse();
+  LOG_INFO("[SDLPlayer] Loading video {}, length: {}, opened in {}us "
+           "(audio decoder: {}us, video decoder: {}us)",
+           url, getTotalTime(), last_open_us_,
+           enable_audio_ ? audio_decoder_->lastOpenTime() : 0,
+           enable_video_ ? video_decoder_->lastOpenTime() : 0);
   // LOG_INFO("[SDLPlayer] Loading config...");
   // config_.dump(std::cout);
 
+  // close() was called meanwhile, from another thread
+  if (is_over_) {
+    LOG_WARN("[SDLPlayer] Opening {} was aborted", url);
+    this->close();
+    return false;
+  }
   is_finished_ = false;
-  is_over_ = false;
-  status_ = Player::READY;
+  need2open_output_ = true;
+  trick_mode_ = trickModeOf(speed_.load());
+  trick_anchor_pts_ = AV_NOPTS_VALUE;
+  // a reverse start plays from the end
+  if (speed_.load() < 0.0f && enable_video_ &&
+      format_context_->duration != AV_NOPTS_VALUE)
+    submitSeek(startTime() + format_context_->duration, false);
 
   read_thread_.dispatch(&SDLPlayer::onReadFrame, this);
   if (enable_audio_) {
@@ -227,18 +318,111 @@ bool SDLPlayer::openUrl(const std::string &url) {
     video_decode_thread_.dispatch(&SDLPlayer::onVideoDecodeFrame, this);
   }
 
-  if (config_.play_after_ready) {
-    return play();
+  if (config_.common.stall_timeout_ms > 0) {
+    // a stage is expected to move while there is input left for it
+    auto reading = [this] { return !is_finished_; };
+    auto videoDecoding = [this, reading] {
+      return !is_reversing_ && (reading() || video_packet_queue_.depth() > 0);
+    };
+    auto audioDecoding = [this, reading] {
+      return reading() || audio_packet_queue_.depth() > 0;
+    };
+    stall_detector_ = StallDetector::create(config_.common.stall_timeout_ms);
+    stall_detector_->addStage(
+        STAGE_READ, [this] { return demux_stats_.packets.load(); }, reading);
+    if (enable_video_) {
+      stall_detector_->addStage(
+          STAGE_VIDEO_DECODE,
+          [this] { return video_frame_queue_.telemetry().pushes; },
+          videoDecoding);
+      stall_detector_->addStage(
+          STAGE_PRESENT, [this] { return frames_presented_.load(); },
+          [this, videoDecoding] {
+            return videoDecoding() || video_frame_queue_.depth() > 0;
+          });
+    }
+    if (enable_audio_) {
+      stall_detector_->addStage(
+          STAGE_AUDIO_DECODE,
+          [this] { return audio_frame_queue_.telemetry().pushes; },
+          audioDecoding);
+      stall_detector_->addStage(
+          STAGE_AUDIO_CALLBACK, [this] { return audio_samples_played_.load(); },
+          [this, audioDecoding] {
+            return !is_reversing_ &&
+                   (audioDecoding() || audio_frame_queue_.depth() > 0);
+          });
+    }
+    stall_thread_.dispatch(&SDLPlayer::onWatchStalls, this);
+  }
+
+  setStatus(Player::READY);
+  return true;
+}
+// configures the long-lived SDL output for the opened media
+bool SDLPlayer::openOutput() {
+  if (enable_audio_) {
+    SDL_AudioSpec wanted;
+    SDL_memset(&wanted, 0, sizeof(wanted));
+    wanted.freq = config_.audio.sample_rate;
+    wanted.format = convertFFmpegSampleFormatToSDLSampleFormat(
+        (AVSampleFormat)config_.audio.format);
+    if (wanted.format == 0) wanted.format = AUDIO_S16SYS;
+    wanted.channels = config_.audio.channels;
+    wanted.samples =
+        latencyToSamples(config_.audio.latency_ms, config_.audio.sample_rate);
+    wanted.callback = SDLPlayer::sdlAudioCallback;
+    wanted.userdata = this;
+
+    // the device stays open between files, it is reopened only on a new spec
+    if (!audio_sink_->configureAudio(wanted)) {
+      LOG_ERROR("[SDLPlayer] Failed to open audio device");
+      this->close();
+      return false;
+    }
+    // the decode thread converts to what the device actually runs at
+    const SDL_AudioSpec &obtained = audio_sink_->audioSpec();
+    audio_target_ = Resampler::Info{
+        obtained.channels,
+        convertSDLSampleFormatToFFmpegSampleFormat(obtained.format),
+        obtained.freq};
+    LOG_INFO("[SDLPlayer] Audio output latency {}us", audioLatency());
   }
+
+  if (enable_video_) {
+    // the window is kept between files, it is resized only on a new size
+    VideoSink::Spec spec;
+    spec.title = url_;
+    spec.xleft = config_.video.xleft;
+    spec.ytop = config_.video.ytop;
+    spec.width = config_.video.width;
+    spec.height = config_.video.height;
+    if (!video_sink_->configureVideo(spec)) {
+      LOG_ERROR("[SDLPlayer] Could not create video output");
+      this->close();
+      return false;
+    }
+  }
+
+  {
+    Mutex::lock locker(output_mutex_);
+    need2open_output_ = false;
+  }
+  output_cond_.notify_all();
   return true;
 }
+
 bool SDLPlayer::play() {
+  if (need2open_output_ && !openOutput()) {
+    setStatus(Player::BROKEN);
+    return false;
+  }
   need2pause_ = false;
 
   // auto pauseDuration = av_gettime() - video_clock_.current();
   // video_clock_.setTs(pauseDuration + video_clock_.current());
 
-  status_ = Player::PLAYING;
+  setStatus(Player::PLAYING);
   // play_thread_.dispatch(&SDLPlayer::onPlay, this);
   onPlay();
   return true;
@@ -247,9 +431,7 @@ void SDLPlayer::onPlay() {
   // Control Audio Play
   if (enable_audio_) {
     audio_decode_thread_.open();
-    SDL_LockAudioDevice(audio_device_id_);
-    SDL_PauseAudioDevice(audio_device_id_, 0);
-    SDL_UnlockAudioDevice(audio_device_id_);
+    audio_sink_->pauseAudio(false);
   }
   // Control Video Play
   if (enable_video_) {
@@ -264,35 +446,53 @@ bool SDLPlayer::replay() {
   if (status_ != PAUSED) return false;
 
   need2pause_ = false;
+  // trick play is paced again from the next shown frame
+  trick_anchor_pts_ = AV_NOPTS_VALUE;
+  audio_clock_.setPaused(false);
+  video_clock_.setPaused(false);
+  external_clock_.setPaused(false);
 #if 1
   av_read_play(format_context_);
 #endif
 
-  status_ = Player::PLAYING;
+  setStatus(Player::PLAYING);
+  wakeRenderLoop();
   return true;
 }
 bool SDLPlayer::pause() {
   if (status_ != PLAYING) return false;
 
   need2pause_ = true;
+  audio_clock_.setPaused(true);
+  video_clock_.setPaused(true);
+  external_clock_.setPaused(true);
   last_paused_time_ = getCurrentPosition();
 #if 1
   av_read_pause(format_context_);
 #endif
 
-  status_ = Player::PAUSED;
+  setStatus(Player::PAUSED);
   return true;
 }
 void SDLPlayer::close() {
- is_finished_ = true;
-  is_over_ = true;
-
-  if (enable_audio_) {
-    SDL_LockAudioDevice(audio_device_id_);
-    SDL_PauseAudioDevice(audio_device_id_, 1);
-    SDL_UnlockAudioDevice(audio_device_id_);
-    SDL_CloseAudioDevice(audio_device_id_);
+  // an open in flight is aborted through is_over_ and the queued ones are
+  // dropped, unless the open thread itself gives up
+  bool isOpening = open_thread_.isCurrent();
+  std::deque<std::pair<std::string, OpenCallback>> cancelledOpens;
+  {
+    Mutex::lock locker(open_mutex_);
+    if (!isOpening) cancelledOpens.swap(pending_opens_);
+    is_finished_ = true;
+    is_over_ = true;
   }
+  if (!isOpening) open_thread_.join();
+  { Mutex::lock locker(stall_mutex_); }
+  stall_cond_.notify_all();
+  { Mutex::lock locker(output_mutex_); }
+  output_cond_.notify_all();
+
+  // keep the device open for the next file, only stop pulling samples
+  if (enable_audio_ && audio_sink_->hasAudio()) audio_sink_->pauseAudio(true);
   audio_packet_queue_.close();
   audio_frame_queue_.close();
   video_packet_queue_.close();
@@ -301,62 +501,273 @@ void SDLPlayer::close() {
   audio_decode_thread_.join();
   video_decode_thread_.join();
   read_thread_.join();
+  index_thread_.join();
+  stall_thread_.join();
+  if (format_context_ && keyframe_index_->streamIndex() >= 0)
+    keyframe_index_->save(format_context_->url);
 
   audio_packet_queue_.flush();
   audio_frame_queue_.flush();
   video_packet_queue_.flush();
   video_frame_queue_.flush();
 
-  if (video_codec_context_) {
-    avcodec_free_context(&video_codec_context_);
-    avcodec_close(video_codec_context_);
+  // the contexts stay open in the decoder caches for the next file
+  video_codec_context_ = nullptr;
+  audio_codec_context_ = nullptr;
+  auto cacheStats = frame_cache_->stats();
+  if (cacheStats.hits + cacheStats.misses > 0)
+    LOG_INFO("[SDLPlayer] Frame cache: {} frames, {} bytes, hit rate {:.2f}",
+             cacheStats.frames, cacheStats.bytes, cacheStats.hitRate());
+  frame_cache_->clear();
+  auto stats = this->stats();
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    const auto &stage = stats.stages[i];
+    if (stage.count == 0) continue;
+    LOG_INFO("[SDLPlayer] {}: {} samples, p50 {}us, p99 {}us, max {}us",
+             stageName((PipelineStage)i), stage.count, stage.p50_us,
+             stage.p99_us, stage.max_us);
   }
-  if (audio_codec_context_) {
-    avcodec_free_context(&audio_codec_context_);
-    avcodec_close(audio_codec_context_);
+  reportThroughput();
+  for (auto &histogram : stage_latency_) histogram.reset();
+  auto reportQueue = [](const char *name, const AVQueueTelemetry &t) {
+    if (t.pushes == 0) return;
+    LOG_INFO("[SDLPlayer] {} queue: {} in, depth {}..{}, push blocked {}us "
+             "({} overruns), pop starved {}us ({} underruns)",
+             name, t.pushes, t.low_water, t.high_water, t.push_blocked_us,
+             t.overruns, t.pop_blocked_us, t.underruns);
+  };
+  reportQueue("Video packet", stats.video_packets);
+  reportQueue("Video frame", stats.video_frames);
+  reportQueue("Audio packet", stats.audio_packets);
+  reportQueue("Audio frame", stats.audio_frames);
+  video_packet_queue_.resetTelemetry();
+  video_frame_queue_.resetTelemetry();
+  audio_packet_queue_.resetTelemetry();
+  audio_frame_queue_.resetTelemetry();
+  if (stats.stalls > 0)
+    LOG_INFO("[SDLPlayer] {} stalls", stats.stalls);
+  stalls_ = 0;
+  if (auto pNullSink = std::dynamic_pointer_cast<NullVideoSink>(video_sink_)) {
+    if (pNullSink->frames() > 0)
+      LOG_INFO("[SDLPlayer] Null video output: {} frames, checksum {:08x}",
+               pNullSink->frames(), pNullSink->checksum());
+    pNullSink->resetCounters();
   }
+  if (sync_error_count_ > 0)
+    LOG_INFO("[SDLPlayer] A/V sync error: avg {}us, max {}us over {} frames",
+             sync_error_sum_us_ / sync_error_count_, sync_error_max_us_,
+             sync_error_count_);
+  sync_error_sum_us_ = sync_error_max_us_ = sync_error_count_ = 0;
+  sync_report_time_ = NAN;
   if (format_context_) {
     avformat_close_input(&format_context_);
     avformat_free_context(format_context_);
   }
+  // the pipe protocol leaves the descriptor open
+  if (fifo_fd_ >= 0) ::close(fifo_fd_);
+  fifo_fd_ = -1;
   audio_stream_index_ = video_stream_index_ = -1;
-  seek_pos_ = 0;
+  pending_audio_track_ = pending_video_track_ = -1;
+  need2seek_ = false;
+  is_scrubbing_ = false;
+  seek_request_time_ = 0;
+  cache_seek_target_ = AV_NOPTS_VALUE;
+  pending_step_ = 0;
+  is_reversing_ = false;
+  reverse_end_ = AV_NOPTS_VALUE;
+  reverse_gops_ = 0;
+  trick_mode_ = TRICK_NONE;
+  trick_anchor_pts_ = AV_NOPTS_VALUE;
   audio_clock_.reset();
   video_clock_.reset();
-
-  status_ = Player::INITED;
+  external_clock_.reset();
+  frame_timer_ = NAN;
+  sync_error_us_ = 0;
+  audio_frame_.reset();
+  audio_buf_index_ = audio_buf_size_ = 0;
+  audio_frame_end_ = NAN;
+
+  setStatus(Player::INITED);
+  for (auto &request : cancelledOpens) {
+    if (request.second) request.second(false);
+  }
 }
 
 void SDLPlayer::seek(int64_t position) {
-  if (!need2seek_) {
-    int64_t targetPos = position * AV_TIME_BASE;
-    if (targetPos >= getTotalTime() || targetPos < 0) {
-      LOG_WARN("Invalid seek position, it is further");
-      return;
-    }
-    seek_pos_ = targetPos;
+  is_scrubbing_ = false;
+  requestSeek(position, config_.common.accurate_seek);
+}
+void SDLPlayer::scrub(int64_t position) {
+  is_scrubbing_ = true;
+  requestSeek(position, false);
+}
+void SDLPlayer::endScrub() {
+  if (!is_scrubbing_.exchange(false)) return;
+  int64_t position;
+  {
+    Mutex::lock locker(seek_mutex_);
+    position = scrub_position_;
+  }
+  requestSeek(position, true);
+}
+void SDLPlayer::setSpeed(float speed) {
+  if (!std::isfinite(speed) || speed == 0.0f ||
+      (speed < 0.0f && !enable_video_ && format_context_))
+    return;
+  float oldSpeed = speed_.exchange(speed);
+  config_.common.speed = speed;  // for getSpeed(), on this thread only
+  bool wasReverse = oldSpeed < 0.0f;
+  TrickMode oldMode = trickModeOf(oldSpeed);
+  TrickMode newMode = trickModeOf(speed);
+  if (!format_context_ || video_stream_index_ < 0 ||
+      ((speed < 0.0f) == wasReverse && newMode == oldMode)) {
+    // the trick play clock keeps its position at the new speed
+    trick_anchor_pts_ = AV_NOPTS_VALUE;
+    return;
+  }
+
+  // the read thread switches the direction or the trick mode at the shown
+  // frame
+  double position = video_clock_.get();
+  if (std::isnan(position)) position = startTime() / (double)AV_TIME_BASE;
+  submitSeek((int64_t)(position * AV_TIME_BASE), newMode == TRICK_NONE);
+}
+void SDLPlayer::stepFrame(int direction) {
+  if (!enable_video_ || direction == 0) return;
+  if (isPlaying()) pause();
+  pending_step_ = direction > 0 ? 1 : -1;
+  wakeRenderLoop();
+}
+
+void SDLPlayer::requestSeek(int64_t position, bool accurate) {
+  if (!format_context_) return;
+  // a stream of unknown duration is sought past its end at worst
+  bool isKnownDuration = format_context_->duration != AV_NOPTS_VALUE;
+  if ((isKnownDuration && position >= getTotalTime()) || position < 0) {
+    LOG_WARN("Invalid seek position, it is further");
+    return;
+  }
+  // AV_TIME_BASE on the stream timeline
+  int64_t targetPos = position * 1000;
+  if (format_context_->start_time != AV_NOPTS_VALUE)
+    targetPos += format_context_->start_time;
+
+  bool isSeeking;
+  {
+    Mutex::lock locker(seek_mutex_);
+    scrub_position_ = position;
+    isSeeking = need2seek_ || seek_request_time_ != 0;
+  }
+  // a jump back into the frames shown lately doesn't touch the demuxer,
+  // unless the audio would have to follow it while playing
+  if (!is_scrubbing_ && !isSeeking && !is_reversing_ && enable_video_ &&
+      (isPaused() || !enable_audio_) && frame_cache_->covers(targetPos)) {
+    cache_seek_target_ = targetPos;
+    wakeRenderLoop();
+    return;
+  }
+  submitSeek(targetPos, accurate);
+}
+// the slot only keeps the newest request, older ones that weren't executed
+// yet are dropped
+void SDLPlayer::submitSeek(int64_t target, bool accurate) {
+  {
+    Mutex::lock locker(seek_mutex_);
+    if (need2seek_) seek_coalesced_count_++;
+    seek_request_ = SeekRequest{target, accurate, av_gettime_relative()};
     need2seek_ = true;
   }
+  cache_seek_target_ = AV_NOPTS_VALUE;
+  continue_read_cond_.notify_one();
 }
 // No Bugs!
 int64_t SDLPlayer::getCurrentPosition() const {
-  if (isVideoStreamOnly()) {
-    return video_clock_.current() * av_q2d(format_context_->streams[video_stream_index_]->time_base) * 1000;
-  }
-  // if (isAudioStreamOnly()) {
-  return audio_clock_.current()  * av_q2d(format_context_->streams[audio_stream_index_]->time_base) * 1000;
-  // }
-  // return enable_audio_ ? audio_clock_.current() : video_clock_.current();
+  double position = masterClock();
+  // right after a seek the master may not have caught up
+  if (std::isnan(position))
+    position = syncMode() == PlayerConfig::AUDIO_MASTER ? audio_clock_.get()
+                                                        : video_clock_.get();
+  return std::isnan(position) ? 0 : (int64_t)(position * 1000);
 }
 int64_t SDLPlayer::getTotalTime() const {
   return format_context_->duration / 1000;
 }
 
+bool SDLPlayer::switchAudioTrack(int streamIndex) {
+  if (!enable_audio_ || !isTrackOf(streamIndex, AVMEDIA_TYPE_AUDIO))
+    return false;
+  pending_audio_track_ = streamIndex;
+  return true;
+}
+bool SDLPlayer::switchVideoTrack(int streamIndex) {
+  if (!enable_video_ || !isTrackOf(streamIndex, AVMEDIA_TYPE_VIDEO))
+    return false;
+  pending_video_track_ = streamIndex;
+  return true;
+}
+std::vector<int> SDLPlayer::tracks(AVMediaType type) const {
+  std::vector<int> indexes;
+  if (!format_context_) return indexes;
+  for (unsigned int i = 0; i < format_context_->nb_streams; i++) {
+    if (format_context_->streams[i]->codecpar->codec_type == type)
+      indexes.push_back(i);
+  }
+  return indexes;
+}
+
+bool SDLPlayer::isTrackOf(int streamIndex, AVMediaType type) const {
+  return format_context_ && streamIndex >= 0 &&
+         streamIndex < (int)format_context_->nb_streams &&
+         format_context_->streams[streamIndex]->codecpar->codec_type == type;
+}
+void SDLPlayer::applyStreamDiscard() {
+  for (unsigned int i = 0; i < format_context_->nb_streams; i++) {
+    bool selected = (int)i == audio_stream_index_ || (int)i == video_stream_index_;
+    format_context_->streams[i]->discard =
+        selected ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+  }
+}
+// runs on the read thread. The new stream starts at the playback position:
+// the decoder needs a keyframe, and the packets queued so far are ahead of
+// the clock. An accurate seek there restarts both queues on a new serial.
+void SDLPlayer::applyTrackSwitch() {
+  bool isSwitched = false;
+  int audioTrack = pending_audio_track_.exchange(-1);
+  if (audioTrack >= 0 && audioTrack != audio_stream_index_) {
+    audio_stream_index_ = audioTrack;
+    isSwitched = true;
+    LOG_INFO("[SDLPlayer] Switch audio track to stream #{}", audioTrack);
+  }
+  int videoTrack = pending_video_track_.exchange(-1);
+  if (videoTrack >= 0 && videoTrack != video_stream_index_) {
+    video_stream_index_ = videoTrack;
+    isSwitched = true;
+    frame_cache_->clear();
+    LOG_INFO("[SDLPlayer] Switch video track to stream #{}", videoTrack);
+  }
+  if (!isSwitched) return;
+  applyStreamDiscard();
+
+  double position = masterClock();
+  if (std::isnan(position))
+    position = enable_audio_ ? audio_clock_.get() : video_clock_.get();
+  int64_t target = std::isnan(position) ? startTime()
+                                        : (int64_t)(position * AV_TIME_BASE);
+  // a seek already waiting restarts the decoders as well
+  Mutex::lock locker(seek_mutex_);
+  if (need2seek_) return;
+  seek_request_ = SeekRequest{target, true, av_gettime_relative()};
+  need2seek_ = true;
+}
+
 bool SDLPlayer::checkConfig() {
   bool isNoProblem = true;
   if (config_.enable_video) {
     // check video configurations
     isNoProblem &=
+        expect(std::isfinite(config_.common.speed) &&
+                   config_.common.speed != 0.0f,
+               "Speed must be finite and not 0") &&
         expect(config_.video.frame_rate != 0,
                "Frame Rate mustn't be 0 on Video") &&
         expect(config_.video.width != 0, "Width mustn't be 0 on Video") &&
@@ -366,6 +777,8 @@ bool SDLPlayer::checkConfig() {
     // check audio configurations
     isNoProblem &= expect(config_.audio.sample_rate > 0,
                           "Sample rate must be greater than 0 on Audio") &&
+                   expect(config_.audio.latency_ms > 0,
+                          "Latency must be greater than 0 on Audio") &&
                    expect(config_.audio.volume >= 0.0f,
                           "Volume mustn't be a negative number on Audio");
   }
@@ -380,113 +793,598 @@ bool SDLPlayer::expect(bool condition, const std::string &error) {
 }
 
 void SDLPlayer::onReadFrame() {
+  Tracer::setThreadName("read");
   int r{-1};
+  demux_stats_.reset();
+  int64_t lastPos = avio_tell(format_context_->pb);
+  // the next keyframe is the one a GOP skip landed on
+  bool isTrickLanding = false;
+  // since when a full packet queue holds the reads back, AV_NOPTS_VALUE
+  // while it doesn't. The wait happens here rather than in push().
+  int64_t audioFullSince = AV_NOPTS_VALUE;
+  int64_t videoFullSince = AV_NOPTS_VALUE;
+  auto trackFull = [](AVPacketQueue &queue, bool isBlocking, int64_t &since) {
+    int64_t now = av_gettime_relative();
+    if (isBlocking && since == AV_NOPTS_VALUE) {
+      since = now;
+    } else if (!isBlocking && since != AV_NOPTS_VALUE) {
+      queue.recordBlocked(now - since);
+      since = AV_NOPTS_VALUE;
+    }
+  };
 
   while (!is_over_) {
-    if (is_finished_) return;
+    if (is_finished_) break;
+
+    applyTrackSwitch();
 
     // jump to the target frame
     if (need2seek_) {
-      int64_t seekTarget = seek_pos_;
-      r = av_seek_frame(format_context_, -1, seekTarget, AVSEEK_FLAG_BACKWARD);
+      SeekRequest request;
+      {
+        Mutex::lock locker(seek_mutex_);
+        request = seek_request_;
+        need2seek_ = false;
+      }
+      int64_t seekTarget = request.target;
+      // backward, the GOPs before the target are read one by one instead
+      bool isReverse = speed_.load() < 0.0f && enable_video_;
+      if (isReverse) {
+        reverse_end_ = seekTarget;
+        r = 0;
+      }
+      else {
+        setIODeadline(config_.io.seek_timeout_ms);
+        r = seekInput(seekTarget);
+        setIODeadline(0);
+      }
+      if (r < 0 && is_over_) break;
       if (r < 0) {
-        LOG_FATAL("[SDLPlayer] Failed to seek to {} while seeking", seekTarget);
-        return;
+        // a slow or unseekable input goes on from where it was, an
+        // interrupted read left its EOF flag set
+        LOG_WARN("[SDLPlayer] Failed to seek to {}us in {}us: {}", seekTarget,
+                 last_seek_us_, errorString(r));
+        if (format_context_->pb) {
+          format_context_->pb->eof_reached = 0;
+          format_context_->pb->error = 0;
+        }
+        continue;
       }
+      LOG_INFO("[SDLPlayer] Seek to {}us in {}us", seekTarget, last_seek_us_);
       seq_++;
-
+      // the external clock follows the seek, the slaves only re-anchor it
+      // once it drifted away
+      external_clock_.set(seekTarget, AV_TIME_BASE_Q, seq_,
+                          std::fabs(speed_.load()));
+      TrickMode trickMode =
+          isReverse ? TRICK_NONE : trickModeOf(speed_.load());
+
+      // the decoders drop everything before the target on the new serial
+      audio_seek_target_ = video_seek_target_ =
+          request.accurate && !isReverse && trickMode == TRICK_NONE
+              ? seekTarget
+              : AV_NOPTS_VALUE;
+      seek_request_time_ = request.request_time;
+      is_reversing_ = isReverse;
+      reverse_gops_ = 0;
+      trick_mode_ = trickMode;
+      trick_anchor_pts_ = AV_NOPTS_VALUE;
+      isTrickLanding = false;
+      // frame queues are flushed too, so decoders blocked on a full queue
+      // get to see the new serial
       if (enable_audio_) {
         audio_packet_queue_.flush();
+        audio_frame_queue_.flush();
         audio_packet_queue_.step2nextSeq();
       }
       if (enable_video_) {
         video_packet_queue_.flush();
+        video_frame_queue_.flush();
         video_packet_queue_.step2nextSeq();
       }
-      need2seek_ = false;
 
       if (!config_.play_after_ready) {
         // step2nextFrame();
       }
     }
 
+    bool canRead;
+    bool audio_is_full = false, video_is_full = false, is_paused = false;
     {
       Mutex::ulock locker(read_mutex_);
-      continue_read_cond_.wait_for(
+      canRead = continue_read_cond_.wait_for(
           locker, std::chrono::milliseconds(10), [&]() {
-            bool audio_is_full =
+            audio_is_full =
                 enable_audio_ ? audio_packet_queue_.isFull() : false;
-            bool video_is_full =
+            video_is_full =
                 enable_video_ ? video_packet_queue_.isFull() : false;
-            bool is_paused = isPaused();
+            // a paused player still reads until a seek preview is shown
+            is_paused = isPaused() && seek_request_time_ == 0;
+            if (need2seek_) return true;
             if (audio_is_full || video_is_full || is_paused) {
               return false;
             }
             return true;
           });
     }
+    // back-pressure of the decoders, a pause holds the reads back too
+    trackFull(audio_packet_queue_, audio_is_full && !is_paused,
+              audioFullSince);
+    trackFull(video_packet_queue_, video_is_full && !is_paused,
+              videoFullSince);
+    // don't block in push() while a newer seek may be waiting
+    if (!canRead || need2seek_) continue;
+
+    if (is_reversing_) {
+      if (reverse_end_ > startTime()) {
+        readPreviousGop();
+      }
+      else {
+        // reached the start, wait for a seek or a new direction
+        Mutex::ulock locker(read_mutex_);
+        continue_read_cond_.wait_for(locker, std::chrono::milliseconds(10),
+                                     [&]() { return need2seek_.load(); });
+      }
+      continue;
+    }
 
     AVPacketPtr pPkt = makeAVPacket();
-    r = av_read_frame(format_context_, pPkt.get());
+    setIODeadline(config_.io.read_timeout_ms);
+    {
+      TraceScope trace("read");
+      LatencyHistogram::Scope scope(stage_latency_[STAGE_READ]);
+      r = av_read_frame(format_context_, pPkt.get());
+      if (r >= 0 && Tracer::enabled())
+        trace.tag(pPkt->stream_index,
+                  packetTime(pPkt.get(),
+                             format_context_->streams[pPkt->stream_index]
+                                 ->time_base),
+                  pPkt->stream_index == audio_stream_index_
+                      ? audio_packet_queue_.seq()
+                      : video_packet_queue_.seq());
+    }
+    setIODeadline(0);
+    // discarded streams are skipped inside the demuxer, count what it
+    // walked through
+    int64_t pos = avio_tell(format_context_->pb);
+    if (pos > lastPos) demux_stats_.io_bytes += pos - lastPos;
+    lastPos = pos;
     if (r == AVERROR_EOF) {
       LOG_INFO("[SDLPlayer] End of file");
+      keyframe_index_->markComplete();
       is_finished_ = true;
       Mutex::ulock locker(read_mutex_);
       continue_read_cond_.wait_for(
           locker, std::chrono::milliseconds(10), [&]() {
             return false;
           });
-      return;
+      break;
+    }
+    else if (r == AVERROR_EXIT) {
+      if (is_over_) break;
+      LOG_WARN("[SDLPlayer] av_read_frame() timed out after {}ms",
+               config_.io.read_timeout_ms);
+      continue;
     }
     else if (r < 0) {
       LOG_WARN("[SDLPlayer] Some errors on av_read_frame()");
       continue;
     }
 
+    demux_stats_.packets++;
+    demux_stats_.payload_bytes += pPkt->size;
+    if (pPkt->stream_index == keyframe_index_->streamIndex()) {
+      int64_t ts = packetTime(
+          pPkt.get(), format_context_->streams[pPkt->stream_index]->time_base);
+      if (ts != AV_NOPTS_VALUE)
+        keyframe_index_->extend(ts, pPkt->pos, pPkt->flags & AV_PKT_FLAG_KEY);
+    }
+    if (trick_mode_ == TRICK_KEYFRAMES &&
+        pPkt->stream_index == audio_stream_index_) {
+      // the audio is muted while GOPs are skipped
+      demux_stats_.dropped_packets++;
+      continue;
+    }
+    if (trick_mode_ == TRICK_KEYFRAMES &&
+        pPkt->stream_index == video_stream_index_) {
+      if (!(pPkt->flags & AV_PKT_FLAG_KEY)) {
+        demux_stats_.dropped_packets++;
+        continue;
+      }
+      // a GOP which would be shown late is skipped by seeking ahead of the
+      // trick play clock
+      int64_t pts = packetTime(
+          pPkt.get(), format_context_->streams[pPkt->stream_index]->time_base);
+      int64_t now = trickClock();
+      if (!isTrickLanding && pts != AV_NOPTS_VALUE &&
+          now != AV_NOPTS_VALUE && pts < now) {
+        int64_t target =
+            now + (int64_t)(kTrickLeadUS * std::fabs(speed_.load()));
+        setIODeadline(config_.io.seek_timeout_ms);
+        r = seekInput(target);
+        setIODeadline(0);
+        isTrickLanding = r >= 0;
+        if (isTrickLanding) {
+          lastPos = avio_tell(format_context_->pb);
+          continue;
+        }
+      }
+      isTrickLanding = false;
+    }
+
     if (pPkt->stream_index == audio_stream_index_) {
       audio_packet_queue_.push(pPkt);
     }
     else if (pPkt->stream_index == video_stream_index_) {
       video_packet_queue_.push(pPkt);
     }
+    else {
+      demux_stats_.dropped_packets++;
+    }
+  }
+
+  LOG_INFO("[SDLPlayer] Demux: {} packets ({} dropped), {} payload bytes, "
+           "{} I/O bytes, {}us CPU",
+           demux_stats_.packets, demux_stats_.dropped_packets,
+           demux_stats_.payload_bytes, demux_stats_.io_bytes,
+           read_thread_.usage().cpu_us);
+}
+
+// seeks by byte to the indexed keyframe when possible, the demuxer then
+// doesn't have to search for it
+int SDLPlayer::seekInput(int64_t target) {
+  AVClock seekClocker;
+  int r{-1};
+  bool byIndex = false;
+  KeyframeIndex::Entry entry;
+  if (!(format_context_->iformat->flags & AVFMT_NO_BYTE_SEEK) &&
+      keyframe_index_->lookup(target, entry)) {
+    r = av_seek_frame(format_context_, -1, entry.pos, AVSEEK_FLAG_BYTE);
+    byIndex = r >= 0;
+  }
+  if (!byIndex)
+    r = av_seek_frame(format_context_, -1, target, AVSEEK_FLAG_BACKWARD);
+  // the index is only extended by contiguous reading
+  keyframe_index_->interrupt();
+
+  last_seek_us_ = seekClocker.elapse();
+  demux_stats_.seeks++;
+  if (r < 0) demux_stats_.failed_seeks++;
+  LOG_DEBUG("[SDLPlayer] Seek to {}us by {} in {}us", target,
+            byIndex ? "keyframe index" : "timestamp", last_seek_us_);
+  return r;
+}
+
+// reverse playback: queues the GOP ending before reverse_end_ followed by an
+// empty packet, on which the decoder is drained and emits the GOP reversed.
+// The packet queue lets the next earlier GOP be read and decoded while this
+// one is shown.
+void SDLPlayer::readPreviousGop() {
+  int64_t start = startTime();
+  int64_t end = reverse_end_;
+  std::vector<AVPacketPtr> gop;
+  int64_t gopStart = AV_NOPTS_VALUE;
+  // the demuxer may land on a keyframe at or after the end, it is retried
+  // further back
+  for (int64_t target = end - 1;; target -= AV_TIME_BASE) {
+    setIODeadline(config_.io.seek_timeout_ms);
+    int r = seekInput(FFMAX(target, start));
+    setIODeadline(0);
+    if (r < 0 || !readGop(gop)) {
+      if (is_over_ || need2seek_) return;
+      LOG_WARN("[SDLPlayer] No GOP before {}us, reverse playback stops", end);
+      reverse_end_ = start;
+      return;
+    }
+    auto timeBase = format_context_->streams[video_stream_index_]->time_base;
+    gopStart = packetTime(gop.front().get(), timeBase);
+    if (gopStart == AV_NOPTS_VALUE || gopStart < end) break;
+    if (target <= start) {
+      reverse_end_ = start;
+      return;
+    }
+  }
+
+  reverse_gops_++;
+  for (auto &pPkt : gop) {
+    if (need2seek_ || !video_packet_queue_.push(pPkt)) return;
+  }
+  auto pMarker = makeAVPacket();
+  pMarker->stream_index = video_stream_index_;
+  pMarker->pts = av_rescale_q(
+      end, AV_TIME_BASE_Q,
+      format_context_->streams[video_stream_index_]->time_base);
+  if (need2seek_ || !video_packet_queue_.push(pMarker)) return;
+  reverse_end_ = gopStart == AV_NOPTS_VALUE ? start : gopStart;
+}
+// reads from the next video keyframe up to the one after it
+bool SDLPlayer::readGop(std::vector<AVPacketPtr> &gop) {
+  gop.clear();
+  while (!is_over_ && !need2seek_) {
+    AVPacketPtr pPkt = makeAVPacket();
+    setIODeadline(config_.io.read_timeout_ms);
+    int r = av_read_frame(format_context_, pPkt.get());
+    setIODeadline(0);
+    if (r == AVERROR_EXIT && !is_over_) continue;
+    if (r < 0) break;
+
+    demux_stats_.packets++;
+    demux_stats_.payload_bytes += pPkt->size;
+    // the audio is muted backward
+    if (pPkt->stream_index != video_stream_index_) {
+      demux_stats_.dropped_packets++;
+      continue;
+    }
+    bool isKey = pPkt->flags & AV_PKT_FLAG_KEY;
+    if (gop.empty() && !isKey) continue;
+    if (!gop.empty() && isKey) return true;
+    gop.push_back(pPkt);
+  }
+  // a GOP may end at the end of file
+  return !gop.empty() && !is_over_ && !need2seek_;
+}
+SDLPlayer::TrickMode SDLPlayer::trickModeOf(float speed) const {
+  // audio only media keeps playing every sample
+  if (!enable_video_) return TRICK_NONE;
+  if (speed >= config_.common.keyframe_speed) return TRICK_KEYFRAMES;
+  if (speed >= config_.common.nonref_speed) return TRICK_NONREF;
+  return TRICK_NONE;
+}
+int64_t SDLPlayer::trickClock() const {
+  int64_t anchorPts = trick_anchor_pts_;
+  if (anchorPts == AV_NOPTS_VALUE) return AV_NOPTS_VALUE;
+  return anchorPts + (int64_t)((av_gettime_relative() - trick_anchor_time_) *
+                               std::fabs(speed_.load()));
+}
+int64_t SDLPlayer::startTime() const {
+  return format_context_->start_time != AV_NOPTS_VALUE
+             ? format_context_->start_time
+             : 0;
+}
+
+void SDLPlayer::onScanKeyframes(std::string url, int streamIndex) {
+  Tracer::setThreadName("index scan");
+  AVClock scanClocker;
+  AVFormatContext *pFormatContext = avformat_alloc_context();
+  pFormatContext->interrupt_callback.callback = SDLPlayer::scanInterruptCallback;
+  pFormatContext->interrupt_callback.opaque = this;
+  if (avformat_open_input(&pFormatContext, url.c_str(), nullptr, nullptr) < 0)
+    return;
+  if (avformat_find_stream_info(pFormatContext, nullptr) < 0 ||
+      streamIndex >= (int)pFormatContext->nb_streams) {
+    avformat_close_input(&pFormatContext);
+    return;
+  }
+  for (unsigned int i = 0; i < pFormatContext->nb_streams; i++) {
+    if ((int)i != streamIndex)
+      pFormatContext->streams[i]->discard = AVDISCARD_ALL;
+  }
+
+  auto timeBase = pFormatContext->streams[streamIndex]->time_base;
+  std::vector<KeyframeIndex::Entry> entries;
+  AVPacketPtr pPkt = makeAVPacket();
+  int r{-1};
+  while (!is_over_ && (r = av_read_frame(pFormatContext, pPkt.get())) >= 0) {
+    int64_t ts = pPkt->pts != AV_NOPTS_VALUE ? pPkt->pts : pPkt->dts;
+    if (pPkt->stream_index == streamIndex &&
+        (pPkt->flags & AV_PKT_FLAG_KEY) && pPkt->pos >= 0 &&
+        ts != AV_NOPTS_VALUE) {
+      entries.push_back(KeyframeIndex::Entry{
+          av_rescale_q(ts, timeBase, AV_TIME_BASE_Q), pPkt->pos});
+    }
+    av_packet_unref(pPkt.get());
+  }
+  avformat_close_input(&pFormatContext);
+
+  if (r != AVERROR_EOF) return;
+  size_t count = entries.size();
+  keyframe_index_->assign(std::move(entries));
+  LOG_INFO("[SDLPlayer] Indexed {} keyframes of stream #{} in {}us", count,
+           streamIndex, scanClocker.elapse());
+}
+
+int64_t SDLPlayer::frameTime(const AVFrame *frame, AVRational timeBase) {
+  int64_t ts = frame->best_effort_timestamp != AV_NOPTS_VALUE
+                   ? frame->best_effort_timestamp
+                   : frame->pts;
+  if (ts == AV_NOPTS_VALUE) return AV_NOPTS_VALUE;
+  return av_rescale_q(ts, timeBase, AV_TIME_BASE_Q);
+}
+
+int64_t SDLPlayer::packetTime(const AVPacket *packet, AVRational timeBase) {
+  int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+  if (ts == AV_NOPTS_VALUE) return AV_NOPTS_VALUE;
+  return av_rescale_q(ts, timeBase, AV_TIME_BASE_Q);
+}
+
+// drops the first `skip` samples of an audio frame
+AVFramePtr SDLPlayer::trimAudioFrame(AVFramePtr pFrame, int skip,
+                                     AVRational timeBase) {
+  auto pOutFrame = makeAVFrame();
+  pOutFrame->format = pFrame->format;
+  pOutFrame->channels = pFrame->channels;
+  pOutFrame->channel_layout = pFrame->channel_layout;
+  pOutFrame->sample_rate = pFrame->sample_rate;
+  pOutFrame->nb_samples = pFrame->nb_samples - skip;
+  if (av_frame_get_buffer(pOutFrame.get(), 0) < 0) return nullptr;
+
+  av_samples_copy(pOutFrame->extended_data, pFrame->extended_data, 0, skip,
+                  pOutFrame->nb_samples, pFrame->channels,
+                  (AVSampleFormat)pFrame->format);
+  int64_t shift = av_rescale_q(skip, AVRational{1, pFrame->sample_rate},
+                               timeBase);
+  int64_t ts = pFrame->best_effort_timestamp != AV_NOPTS_VALUE
+                   ? pFrame->best_effort_timestamp
+                   : pFrame->pts;
+  pOutFrame->pts = pOutFrame->best_effort_timestamp = ts + shift;
+  return pOutFrame;
+}
+
+// a new queue serial means a seek or a track switch, the decoder is
+// flushed or reacquired for the new stream accordingly
+bool SDLPlayer::reopenDecoderIfSwitched(DecoderCache &decoder,
+                                        AVCodecContext *&codecContext,
+                                        int &decodingIndex, int streamIndex) {
+  if (decodingIndex == streamIndex) {
+    decoder.flush();
+    return true;
+  }
+  codecContext =
+      decoder.acquire(format_context_->streams[streamIndex]->codecpar);
+  if (!codecContext) {
+    LOG_ERROR("[SDLPlayer] Failed to open decoder for stream #{}", streamIndex);
+    return false;
   }
+  decodingIndex = streamIndex;
+  return true;
 }
 
 void SDLPlayer::onVideoDecodeFrame() {
+  Tracer::setThreadName("video decode");
   int r{-1};
+  int serial = video_packet_queue_.seq();
+  int decodingIndex = video_stream_index_;
+  int64_t discardUntil = AV_NOPTS_VALUE;
+  // reverse playback: the GOP being decoded, in presentation order
+  bool isReverse = is_reversing_;
+  std::deque<AVFramePtr> gopFrames;
+  size_t gopBytes = 0;
+  size_t gopCapacity = (size_t)FFMAX(config_.video.reverse_buffer_mb, 1) << 20;
   while (!is_over_) {
     if (video_packet_queue_.isEmpty() && is_finished_) break;
+    // keyframes only while scrubbing or in trick play
+    if (video_codec_context_) {
+      TrickMode trickMode = trick_mode_;
+      video_codec_context_->skip_frame =
+          is_scrubbing_ || trickMode == TRICK_KEYFRAMES ? AVDISCARD_NONKEY
+          : trickMode == TRICK_NONREF                  ? AVDISCARD_NONREF
+                                                       : AVDISCARD_DEFAULT;
+    }
 
     AVPacketPtr pPkt;
     if (!video_packet_queue_.pop(pPkt)) {
       continue_read_cond_.notify_one();
       continue;
     }
-    // if (video_packet_queue_.seq() != seq_) {
-    //   continue;
-    // }
+    if (video_packet_queue_.seq() != serial) {
+      serial = video_packet_queue_.seq();
+      if (!reopenDecoderIfSwitched(*video_decoder_, video_codec_context_,
+                                   decodingIndex, video_stream_index_))
+        break;
+      video_frame_queue_.flush();
+      video_frame_queue_.step2nextSeq();
+      wakeRenderLoop();
+      // set by the read thread for accurate requests only
+      discardUntil = video_seek_target_;
+      isReverse = is_reversing_;
+      gopFrames.clear();
+      gopBytes = 0;
+    }
+    if (pPkt->stream_index != video_stream_index_) continue;
 
-    r = avcodec_send_packet(video_codec_context_, pPkt.get());
+    // an empty packet ends a GOP read backward, the decoder is drained
+    bool isGopEnd = isReverse && !pPkt->data;
+    if (!isGopEnd) video_decoder_->prepare(pPkt.get());
+    // the decoder hands the send time back with the frame of the packet
+    video_codec_context_->reordered_opaque = av_gettime_relative();
+    {
+      TraceScope trace("video send");
+      if (Tracer::enabled())
+        trace.tag(
+            video_stream_index_,
+            packetTime(pPkt.get(),
+                       format_context_->streams[decodingIndex]->time_base),
+            serial);
+      r = avcodec_send_packet(video_codec_context_,
+                              isGopEnd ? nullptr : pPkt.get());
+    }
     if (r < 0) {
       LOG_ERROR("[SDLPlayer] Error sending a packet for decoding");
       break;
     }
     while (true) {
       auto pFrame = makeAVFrame();
-      r = avcodec_receive_frame(video_codec_context_, pFrame.get());
+      {
+        TraceScope trace("video receive", video_stream_index_,
+                         AV_NOPTS_VALUE, serial);
+        r = avcodec_receive_frame(video_codec_context_, pFrame.get());
+        if (r >= 0 && Tracer::enabled())
+          trace.tag(video_stream_index_,
+                    frameTime(pFrame.get(),
+                              format_context_->streams[decodingIndex]
+                                  ->time_base),
+                    serial);
+      }
       if (r == AVERROR_EOF || r == AVERROR(EAGAIN))
         break;
       else if (r < 0) {
         LOG_ERROR("[SDLPlayer] Video frame is broken while playing");
         break;
       }
+      // from here on it carries the decode time for the queue stage
+      int64_t decodedTime = av_gettime_relative();
+      if (pFrame->reordered_opaque != AV_NOPTS_VALUE)
+        stage_latency_[STAGE_VIDEO_DECODE].record(decodedTime -
+                                                  pFrame->reordered_opaque);
+      pFrame->reordered_opaque = decodedTime;
+      if (isReverse) {
+        // the buffer is capped by dropping the earliest frames, they'd be
+        // shown last
+        gopBytes += FrameCache::frameBytes(pFrame.get());
+        gopFrames.push_back(pFrame);
+        while (gopBytes > gopCapacity && gopFrames.size() > 1) {
+          gopBytes -= FrameCache::frameBytes(gopFrames.front().get());
+          gopFrames.pop_front();
+        }
+        continue;
+      }
+      // accurate seek: frames before the target never reach the converter
+      if (discardUntil != AV_NOPTS_VALUE) {
+        auto timeBase = format_context_->streams[decodingIndex]->time_base;
+        int64_t start = frameTime(pFrame.get(), timeBase);
+        int64_t duration =
+            av_rescale_q(pFrame->pkt_duration, timeBase, AV_TIME_BASE_Q);
+        if (start != AV_NOPTS_VALUE && start + duration <= discardUntil)
+          continue;
+        discardUntil = AV_NOPTS_VALUE;
+      }
 
       video_frame_queue_.push(pFrame);
     }
+
+    if (isGopEnd) {
+      video_decoder_->flush();
+      // frames at or after the end were emitted with the later GOP
+      auto timeBase = format_context_->streams[decodingIndex]->time_base;
+      int64_t gopEnd = av_rescale_q(pPkt->pts, timeBase, AV_TIME_BASE_Q);
+      for (auto it = gopFrames.rbegin(); it != gopFrames.rend(); ++it) {
+        int64_t pts = frameTime(it->get(), timeBase);
+        if (pts != AV_NOPTS_VALUE && pts >= gopEnd) continue;
+        if (video_packet_queue_.seq() != serial ||
+            !video_frame_queue_.push(*it))
+          break;
+      }
+      gopFrames.clear();
+      gopBytes = 0;
+      if (reverse_gops_ > 0) reverse_gops_--;
+    }
   }
 }
 void SDLPlayer::onAudioDecodeFrame() {
+  Tracer::setThreadName("audio decode");
   int r{-1};
+  int serial = audio_packet_queue_.seq();
+  int decodingIndex = audio_stream_index_;
+  int64_t discardUntil = AV_NOPTS_VALUE;
+  bool isNewSerial = false;
+  // without video, no render loop shows the seek: its first audio frame
+  // does, so a paused player stops reading
+  auto push = [&](AVFramePtr pFrame) {
+    if (!pushAudioFrame(pFrame) || !isNewSerial) return;
+    isNewSerial = false;
+    if (isAudioStreamOnly() && serial == audio_packet_queue_.seq())
+      onSeekShown();
+  };
   while (!is_over_) {
     if (audio_packet_queue_.isEmpty() && is_finished_) break;
 
@@ -495,41 +1393,168 @@ void SDLPlayer::onAudioDecodeFrame() {
       continue_read_cond_.notify_one();
       continue;
     }
-    // if (audio_packet_queue_.seq() != seq_) {
-    //   avcodec_flush_buffers(audio_codec_context_);
-    // }
+    if (audio_packet_queue_.seq() != serial) {
+      serial = audio_packet_queue_.seq();
+      if (!reopenDecoderIfSwitched(*audio_decoder_, audio_codec_context_,
+                                   decodingIndex, audio_stream_index_))
+        break;
+      audio_frame_queue_.flush();
+      audio_frame_queue_.step2nextSeq();
+      // set by the read thread for accurate requests only
+      discardUntil = audio_seek_target_;
+      audio_tempo_->reset();
+      isNewSerial = true;
+    }
+    // the device format is known once the output is configured by play()
+    if (need2open_output_) {
+      Mutex::ulock locker(output_mutex_);
+      output_cond_.wait(locker,
+                        [this] { return !need2open_output_ || is_over_; });
+    }
+    if (pPkt->stream_index != audio_stream_index_) continue;
 
-    r = avcodec_send_packet(audio_codec_context_, pPkt.get());
+    audio_decoder_->prepare(pPkt.get());
+    audio_codec_context_->reordered_opaque = av_gettime_relative();
+    {
+      TraceScope trace("audio send");
+      if (Tracer::enabled())
+        trace.tag(
+            audio_stream_index_,
+            packetTime(pPkt.get(),
+                       format_context_->streams[decodingIndex]->time_base),
+            serial);
+      r = avcodec_send_packet(audio_codec_context_, pPkt.get());
+    }
     if (r < 0) {
       LOG_ERROR("[SDLPlayer] Error sending a packet for decoding");
       break;
     }
     while (true) {
       auto pFrame = makeAVFrame();
-      r = avcodec_receive_frame(audio_codec_context_, pFrame.get());
+      {
+        TraceScope trace("audio receive", audio_stream_index_,
+                         AV_NOPTS_VALUE, serial);
+        r = avcodec_receive_frame(audio_codec_context_, pFrame.get());
+        if (r >= 0 && Tracer::enabled())
+          trace.tag(audio_stream_index_,
+                    frameTime(pFrame.get(),
+                              format_context_->streams[decodingIndex]
+                                  ->time_base),
+                    serial);
+      }
       if (r == AVERROR_EOF || r == AVERROR(EAGAIN))
         break;
       else if (r < 0) {
         LOG_ERROR("[SDLPlayer] Audio frame is broken while playing");
         break;
       }
+      if (pFrame->reordered_opaque != AV_NOPTS_VALUE)
+        stage_latency_[STAGE_AUDIO_DECODE].record(av_gettime_relative() -
+                                                  pFrame->reordered_opaque);
+      // accurate seek: drop whole frames before the target and trim the
+      // one containing it to the exact sample
+      if (discardUntil != AV_NOPTS_VALUE) {
+        auto timeBase = format_context_->streams[decodingIndex]->time_base;
+        int64_t start = frameTime(pFrame.get(), timeBase);
+        if (start != AV_NOPTS_VALUE) {
+          int64_t skip = av_rescale(discardUntil - start, pFrame->sample_rate,
+                                    AV_TIME_BASE);
+          if (skip >= pFrame->nb_samples) continue;
+          if (skip > 0) {
+            pFrame = trimAudioFrame(pFrame, (int)skip, timeBase);
+            if (!pFrame) continue;
+          }
+        }
+        discardUntil = AV_NOPTS_VALUE;
+      }
+
+      // the speed is applied by time stretching, the pitch stays
+      auto timeBase = format_context_->streams[decodingIndex]->time_base;
+      if (!audio_tempo_->init(pFrame.get(), timeBase,
+                              std::fabs(speed_.load())) ||
+          audio_tempo_->isPassthrough()) {
+        push(pFrame);
+        continue;
+      }
+      if (!audio_tempo_->send(pFrame)) {
+        LOG_WARN("[SDLPlayer] Failed to change the audio tempo");
+        continue;
+      }
+      AVFramePtr pTempoFrame;
+      while (audio_tempo_->receive(pTempoFrame))
+        push(pTempoFrame);
+    }
+  }
+}
 
-      audio_frame_queue_.push(pFrame);
+void SDLPlayer::wakeRenderLoop() {
+  { Mutex::lock locker(output_mutex_); }
+  output_cond_.notify_all();
+}
 
-      if (pFrame->pts != AV_NOPTS_VALUE)
-        audio_clock_.setTs(pFrame->pts + pFrame->nb_samples * AV_TIME_BASE /
-                                             pFrame->sample_rate);
-      else
-        audio_clock_.setTs(-1);
+void SDLPlayer::onSeekShown() {
+  int64_t requestTime = seek_request_time_.exchange(0);
+  if (requestTime > 0) {
+    last_seek_display_us_ = av_gettime_relative() - requestTime;
+    LOG_INFO("[SDLPlayer] Seek displayed in {}us ({} coalesced)",
+             last_seek_display_us_, seek_coalesced_count_.exchange(0));
+  }
+}
+
+bool SDLPlayer::pushAudioFrame(AVFramePtr pFrame) {
+  if (pFrame->format != audio_target_.format ||
+      pFrame->sample_rate != audio_target_.sample_rate ||
+      pFrame->channels != audio_target_.channels) {
+    auto pOutFrame = makeAVFrame();
+    if (!resampler_->init(pFrame->channels, (AVSampleFormat)pFrame->format,
+                          pFrame->sample_rate, audio_target_.channels,
+                          audio_target_.format, audio_target_.sample_rate) ||
+        !resampler_->resample(pFrame, pOutFrame)) {
+      LOG_WARN("[SDLPlayer] Failed to convert audio to the device format");
+      return false;
     }
+    pFrame = pOutFrame;
   }
+  audio_frame_queue_.push(pFrame);
+  return true;
 }
 
 void SDLPlayer::onSDLVideoPlay() {
   SDL_Event event;
-  int r{-1};
+  Tracer::setThreadName("render");
+  render_probe_.attach();
+  int renderSerial = video_frame_queue_.seq();
+  // the shown frame and the newest one taken from the queue, AV_TIME_BASE.
+  // While replaying, frames come from the cache until it reaches the queue.
+  int64_t shownPts = AV_NOPTS_VALUE;
+  int64_t shownEnd = AV_NOPTS_VALUE;
+  int64_t queuedPts = AV_NOPTS_VALUE;
+  bool isReplaying = false;
+  bool isResyncing = false;
+  AVFramePtr pHeld;  // trick play: popped, not due yet
+  // the display state follows the frames actually presented
+  auto show = [&](const AVFramePtr &pFrame, int64_t pts) {
+    PresentResult result = presentFrame(pFrame);
+    if (result != PRESENT_OK) return result;
+    auto timeBase = format_context_->streams[video_stream_index_]->time_base;
+    int64_t duration =
+        pFrame->pkt_duration > 0
+            ? av_rescale_q(pFrame->pkt_duration, timeBase, AV_TIME_BASE_Q)
+            : (int64_t)(AV_TIME_BASE / config_.video.frame_rate);
+    shownPts = pts;
+    shownEnd = pts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE : pts + duration;
+    return PRESENT_OK;
+  };
+  // the cache ran out of frames, the demuxer continues after the shown one
+  auto resync = [&]() {
+    isReplaying = false;
+    if (shownEnd == AV_NOPTS_VALUE) return;
+    submitSeek(shownEnd, true);
+    isResyncing = true;
+  };
+
   while (!is_over_) {
-    while (SDL_PollEvent(&event)) {
+    while (is_windowed_ && SDL_PollEvent(&event)) {
       switch (event.type) {
       case SDL_QUIT:
         this->destroy();
@@ -540,197 +1565,353 @@ void SDLPlayer::onSDLVideoPlay() {
         case SDLK_SPACE:
           this->onPauseToggle();
           break;
+        case SDLK_COMMA:
+          this->stepFrame(-1);
+          break;
+        case SDLK_PERIOD:
+          this->stepFrame(1);
+          break;
+        case SDLK_t:
+          if (Tracer::enabled())
+            Tracer::instance().exportJson(config_.trace.path);
+          break;
         }
         break;
       }
     }
 
-    if (isPaused()) continue;
+    if (video_frame_queue_.seq() != renderSerial) isReplaying = false;
 
-    if (video_frame_queue_.isEmpty() && is_finished_) break;
+    int64_t cacheTarget = cache_seek_target_.exchange(AV_NOPTS_VALUE);
+    if (cacheTarget != AV_NOPTS_VALUE) {
+      int64_t pts;
+      auto pFrame = frame_cache_->at(cacheTarget, pts);
+      if (pFrame && show(pFrame, pts) == PRESENT_OK) {
+        isReplaying = pts != queuedPts;
+        LOG_INFO("[SDLPlayer] Seek to {}us served by the frame cache",
+                 cacheTarget);
+      }
+      else {
+        submitSeek(cacheTarget, config_.common.accurate_seek);
+      }
+      continue;
+    }
 
-    AVFramePtr pFrame;
-    if (!video_frame_queue_.pop(pFrame)) {
+    int step = isPaused() ? pending_step_.exchange(0) : 0;
+    if (step < 0 && shownPts != AV_NOPTS_VALUE) {
+      int64_t pts;
+      auto pFrame = frame_cache_->previous(shownPts, pts);
+      if (pFrame && show(pFrame, pts) == PRESENT_OK) {
+        isReplaying = true;
+      }
+      else {
+        // the previous frame ends where the shown one starts
+        isReplaying = false;
+        submitSeek(shownPts - 1, true);
+      }
+      continue;
+    }
+    if (step > 0 && isReplaying) {
+      int64_t pts;
+      auto pFrame = frame_cache_->next(shownPts, pts);
+      if (pFrame && show(pFrame, pts) == PRESENT_OK)
+        isReplaying = pts != queuedPts;
+      else
+        resync();
       continue;
     }
 
-    // we get: frame
-    // the things can be done in the zone: process the video frame
-    auto pOutFrame = makeAVFrame();
-    auto targetFormat = (config_.video.format == AV_PIX_FMT_NONE)
-                            ? (AVPixelFormat)pFrame->format
-                            : config_.video.format;
-    converter_->init(pFrame->width, pFrame->height,
-                     (AVPixelFormat)pFrame->format, config_.video.width,
-                     config_.video.height, targetFormat);
-    r = av_image_alloc(pOutFrame->data, pOutFrame->linesize,
-                       config_.video.width, config_.video.height, targetFormat,
-                       1);
-    if (r < 0) {
-      videoDelay();
+    // while playing, the cache is replayed until it joins the queue. The
+    // audio isn't replayed, so it resumes from the demuxer with the video.
+    if (isReplaying && !isPaused()) {
+      int64_t pts;
+      AVFramePtr pFrame;
+      if (!enable_audio_) pFrame = frame_cache_->next(shownPts, pts);
+      if (pFrame && show(pFrame, pts) == PRESENT_OK) {
+        isReplaying = pts != queuedPts;
+        videoDelay();
+      }
+      else {
+        resync();
+      }
       continue;
     }
 
-    static int c = 0;
-    bool success = converter_->convert(pFrame, pOutFrame);
-    c += success;
-    if (!success) {
-      av_freep(&pOutFrame->data[0]);
-      videoDelay();
+    // a paused player still shows the first frame after a seek and steps
+    // forward frame by frame
+    bool isNewSerial = video_frame_queue_.seq() != renderSerial;
+    if ((isResyncing || (isPaused() && step == 0)) && !isNewSerial) {
+      // until a new serial, a cache seek, a step, replay() or close(), see
+      // wakeRenderLoop(). A window still polls its events meanwhile.
+      auto isWoken = [&] {
+        return is_over_ || video_frame_queue_.seq() != renderSerial ||
+               cache_seek_target_ != AV_NOPTS_VALUE ||
+               (!isResyncing && (!isPaused() || pending_step_ != 0));
+      };
+      Mutex::ulock locker(output_mutex_);
+      if (is_windowed_)
+        output_cond_.wait_for(locker, std::chrono::milliseconds(10), isWoken);
+      else
+        output_cond_.wait(locker, isWoken);
       continue;
     }
-    LOG_DEBUG("Convert fault count: {}", c);
-    LOG_DEBUG("VideoPacketQueueSize: {}", video_packet_queue_.size());
-    LOG_DEBUG("VideoFrameQueueSize: {}", video_frame_queue_.size());
-    // TODO:
 
-    // auto currTime = av_rescale_q(pFrame->pts, video_codec_context_->time_base,
-                                //  AV_TIME_BASE_Q);
-    auto currTs = pFrame->pts;
-    video_clock_.setTs(currTs);
-    int64_t secs = getCurrentPosition() / 1000;
-    LOG_DEBUG("CurrentTimestamp: {} | {}m:{:02}s", secs,
-              secs / 60, secs % 60);
-
-    SDL_PixelFormatEnum format =
-        convertFFmpegPixelFormatToSDLPixelFormat(config_.video.format);
-    SDL_Texture *pTexture =
-        SDL_CreateTexture(renderer_, format, SDL_TEXTUREACCESS_STREAMING,
-                          config_.video.width, config_.video.height);
-    if (pTexture == nullptr) {
-      LOG_ERROR("[SDLPlayer] Failed to create texture while playing");
-      av_freep(&pOutFrame->data[0]);
+    if (pHeld && isNewSerial) pHeld.reset();
+    if (video_frame_queue_.isEmpty() && !pHeld && is_finished_) break;
+
+    AVFramePtr pFrame = std::move(pHeld);
+    AVFramePtr pHeldBefore = pFrame;
+    if (!pFrame && !video_frame_queue_.pop(pFrame)) {
+      // retried once the decoder caught up
+      if (step != 0) pending_step_ = step;
+      // reverse playback stops on the first frame
+      if (is_reversing_ && isPlaying() && reverse_end_ <= startTime() &&
+          reverse_gops_ == 0 && video_packet_queue_.isEmpty())
+        pause();
+      continue;
+    }
+    isResyncing = false;
+    // a held frame was measured when it was first taken
+    if (pFrame != pHeldBefore && pFrame->reordered_opaque != AV_NOPTS_VALUE)
+      stage_latency_[STAGE_VIDEO_QUEUE].record(av_gettime_relative() -
+                                               pFrame->reordered_opaque);
+
+    auto timeBase = format_context_->streams[video_stream_index_]->time_base;
+    int64_t pts = frameTime(pFrame.get(), timeBase);
+    // trick play shows a frame once the clock got there, instead of
+    // waiting a frame duration
+    bool isTrickPlay = trick_mode_ != TRICK_NONE;
+    if (isTrickPlay && !isPaused() && !isNewSerial && pts != AV_NOPTS_VALUE) {
+      int64_t now = trickClock();
+      if (now != AV_NOPTS_VALUE && pts > now) {
+        pHeld = pFrame;
+        int64_t waitUS = (pts - now) / std::fabs(speed_.load());
+        std::this_thread::sleep_for(
+            std::chrono::microseconds(FFMIN(waitUS, 10000)));
+        continue;
+      }
+    }
+    PresentResult result = show(pFrame, pts);
+    if (result == PRESENT_FAILED) {
       videoDelay();
       break;
     }
+    // dropped: neither cached nor counted as the frame after a seek
+    if (result == PRESENT_SKIPPED) continue;
+    if (isTrickPlay && pts != AV_NOPTS_VALUE &&
+        trick_anchor_pts_ == AV_NOPTS_VALUE) {
+      trick_anchor_time_ = av_gettime_relative();
+      trick_anchor_pts_ = pts;
+    }
+    // frames shown backward or skipped over aren't linked in display order
+    if (!is_reversing_ && !isTrickPlay)
+      frame_cache_->put(pFrame, pts, isNewSerial ? AV_NOPTS_VALUE : queuedPts);
+    queuedPts = pts;
+
+    if (isNewSerial) {
+      renderSerial = video_frame_queue_.seq();
+      onSeekShown();
+    }
 
-    if (format == SDL_PIXELFORMAT_YV12 || format == SDL_PIXELFORMAT_IYUV)
-      SDL_UpdateYUVTexture(pTexture, nullptr, pOutFrame->data[0],
-                           pOutFrame->linesize[0], pOutFrame->data[1],
-                           pOutFrame->linesize[1], pOutFrame->data[2],
-                           pOutFrame->linesize[2]);
-    else
-      SDL_UpdateTexture(pTexture, nullptr, pOutFrame->data[0],
-                        pOutFrame->linesize[0]);
+    if (!isPaused() && !isTrickPlay) videoDelay();
+  }
 
-    SDL_RenderClear(renderer_);
-    SDL_RenderCopy(renderer_, pTexture, nullptr, nullptr);
-    SDL_RenderPresent(renderer_);
-    SDL_DestroyTexture(pTexture);
+  render_probe_.detach();
+  if (!is_over_) setStatus(Player::END);
+  // the output context outlives the media, see destroy()
+  close();
+}
+// converts, uploads and presents one frame
+SDLPlayer::PresentResult SDLPlayer::presentFrame(const AVFramePtr &pFrame) {
+  int r{-1};
+  // we get: frame
+  // the things can be done in the zone: process the video frame
+  auto pOutFrame = makeAVFrame();
+  auto targetFormat = (config_.video.format == AV_PIX_FMT_NONE)
+                          ? (AVPixelFormat)pFrame->format
+                          : config_.video.format;
+  converter_->init(pFrame->width, pFrame->height,
+                   (AVPixelFormat)pFrame->format, config_.video.width,
+                   config_.video.height, targetFormat);
+  r = av_image_alloc(pOutFrame->data, pOutFrame->linesize,
+                     config_.video.width, config_.video.height, targetFormat,
+                     1);
+  if (r < 0) {
+    LOG_WARN("[SDLPlayer] Failed to allocate the converted frame");
+    return PRESENT_SKIPPED;
+  }
 
-    // every frame is converted.
-    // the data which stores image is allocated in the heap, so we need
-    // to free it here
+  static int c = 0;
+  bool success;
+  int64_t tracePts = AV_NOPTS_VALUE;
+  if (Tracer::enabled())
+    tracePts = frameTime(
+        pFrame.get(), format_context_->streams[video_stream_index_]->time_base);
+  int traceSerial = video_frame_queue_.seq();
+  {
+    TraceScope trace("convert", video_stream_index_, tracePts, traceSerial);
+    LatencyHistogram::Scope scope(stage_latency_[STAGE_CONVERT]);
+    success = converter_->convert(pFrame, pOutFrame);
+  }
+  c += success;
+  if (!success) {
+    av_freep(&pOutFrame->data[0]);
+    return PRESENT_SKIPPED;
+  }
+  LOG_DEBUG("Convert fault count: {}", c);
+  // TODO:
+
+  // auto currTime = av_rescale_q(pFrame->pts, video_codec_context_->time_base,
+                              //  AV_TIME_BASE_Q);
+  int64_t currTs = frameTime(
+      pFrame.get(), format_context_->streams[video_stream_index_]->time_base);
+  if (currTs != AV_NOPTS_VALUE) {
+    // unpaced, the clock is virtual: it stands at the last frame
+    video_clock_.set(currTs, AV_TIME_BASE_Q, video_frame_queue_.seq(),
+                     config_.common.unpaced ? 0.0 : speed_.load());
+    syncExternalClock(video_clock_, video_frame_queue_.seq());
+  }
+  int64_t secs = getCurrentPosition() / 1000;
+  LOG_DEBUG("CurrentTimestamp: {} | {}m:{:02}s", secs,
+            secs / 60, secs % 60);
+
+  pOutFrame->format = targetFormat;
+  pOutFrame->width = config_.video.width;
+  pOutFrame->height = config_.video.height;
+  pOutFrame->pts = currTs;
+  {
+    TraceScope trace("upload", video_stream_index_, tracePts, traceSerial);
+    LatencyHistogram::Scope scope(stage_latency_[STAGE_UPLOAD]);
+    success = video_sink_->updateVideo(pOutFrame.get());
+  }
+  if (!success) {
+    LOG_ERROR("[SDLPlayer] Failed to update the video output while playing");
     av_freep(&pOutFrame->data[0]);
-    videoDelay();
+    return PRESENT_FAILED;
   }
 
-  destroy();
+  {
+    TraceScope trace("present", video_stream_index_, tracePts, traceSerial);
+    LatencyHistogram::Scope scope(stage_latency_[STAGE_PRESENT]);
+    video_sink_->presentVideo();
+  }
+  frames_presented_++;
+  markOutput();
+
+  // every frame is converted.
+  // the data which stores image is allocated in the heap, so we need
+  // to free it here
+  av_freep(&pOutFrame->data[0]);
+  return PRESENT_OK;
 }
 void SDLPlayer::onSDLAudioPlay(Uint8 *stream, int len) {
-  if (isPaused()) return;
+  double callbackTime = AVMediaClock::now();
+  const SDL_AudioSpec &spec = audio_sink_->audioSpec();
+  // SDL doesn't clear the stream, every byte has to be written
+  if (isPaused()) {
+    memset(stream, spec.silence, len);
+    return;
+  }
+  Tracer::setThreadName("audio callback");
+  // SDL's thread outlives the file, the probe is reset at close
+  if (!audio_callback_probe_.isCurrent()) {
+    AVThread::setCurrentName("AudioCallback");
+    audio_callback_probe_.attach();
+  }
+  TraceScope trace("audio callback", audio_stream_index_, AV_NOPTS_VALUE,
+                   audio_frame_serial_);
+  LatencyHistogram::Scope scope(stage_latency_[STAGE_AUDIO_CALLBACK]);
 
-  int len1;
-  // TODO: implement me!
+  int written = len;
+  int bytesPerSample = spec.channels * (SDL_AUDIO_BITSIZE(spec.format) / 8);
+  int64_t playedBytes = 0;
   while (len > 0) {
-    bool silent = false;
-    if (audio_buffer_->remain() <= 0) {
-      AVFramePtr pFrame;
-      bool success = audio_frame_queue_.pop(pFrame);
-      silent = !success;
-#if 1
-      audio_buffer_->fill(pFrame->extended_data[0], pFrame->linesize[0]);
-#else
-      if (success) {
-        auto pOutFrame = makeAVFrame();
-        auto targetFormat = config_.audio.format == AV_SAMPLE_FMT_NONE
-                                ? (AVSampleFormat)pFrame->format
-                                : config_.audio.format;
-
-        pOutFrame->format = targetFormat;
-        pOutFrame->sample_rate = config_.audio.sample_rate;
-        pOutFrame->channels = config_.audio.channels;
-        pOutFrame->channel_layout =
-            av_get_default_channel_layout(config_.audio.channels);
-
-        success = resampler_->init(pFrame->channels, (AVSampleFormat)pFrame->format,
-                         pFrame->sample_rate, config_.audio.channels,
-                         targetFormat, config_.audio.sample_rate);
-        LOG_DEBUG("init resampler {}", success);
-        audio_buffer_->clear();
-        success = resampler_->resample(pFrame, pOutFrame);
-        LOG_DEBUG("resample resampler {}", success);
-        if (success) {
-          audio_buffer_->fill(pOutFrame->extended_data[0], pOutFrame->linesize[0]);
-          av_freep(&pOutFrame->extended_data[0]);
-        } else {
-          silent = true;
-        }
-      }
-#endif
+    // unpaced, the sink waits for the decoder instead of playing silence
+    while (config_.common.unpaced && audio_buf_index_ >= audio_buf_size_ &&
+           !is_over_ && !(is_finished_ && audio_packet_queue_.isEmpty()) &&
+           !nextAudioFrame())
+      audio_frame_queue_.waitForData(10);
+    if (audio_buf_index_ >= audio_buf_size_ && !nextAudioFrame()) {
+      // audio only media ends here, otherwise the video loop reports it
+      if (isAudioStreamOnly() && is_finished_ &&
+          audio_packet_queue_.isEmpty() && status_ != Player::END)
+        setStatus(Player::END);
+      memset(stream, spec.silence, len);
+      break;
     }
 
-    LOG_DEBUG("AudioPacketQueueSize: {}", audio_packet_queue_.size());
-    LOG_DEBUG("AudioFrameQueueSize: {}", audio_frame_queue_.size());
-
-    // VolumeController::scale(config_.audio.channels, pFrame,
-    //                         config_.audio.volume, SDL_MIX_MAXVOLUME);
 
-    len1 = audio_buffer_->remain();
-    if (len1 > len) len1 = len;
-    silent = false;
-    if (!config_.audio.is_muted && !silent &&
-        config_.audio.volume * 100 >= SDL_MIX_MAXVOLUME) {
-      memcpy(stream, audio_buffer_->peek(), len1);
-    } else {
-      // silent
-      memset(stream, 0, len1);
+    int len1 = FFMIN(audio_buf_size_ - audio_buf_index_, len);
+    const uint8_t *pData = audio_frame_->data[0] + audio_buf_index_;
+    if (config_.audio.is_muted) {
+      memset(stream, spec.silence, len1);
     }
-    if (!config_.audio.is_muted) {
-      SDL_MixAudioFormat(stream, audio_buffer_->peek(), AUDIO_S16SYS, len1,
-                          config_.audio.volume * 100);
+    else if (config_.audio.volume * SDL_MIX_MAXVOLUME >= SDL_MIX_MAXVOLUME) {
+      memcpy(stream, pData, len1);
+    }
+    else {
+      memset(stream, spec.silence, len1);
+      SDL_MixAudioFormat(stream, pData, spec.format, len1,
+                         (int)(config_.audio.volume * SDL_MIX_MAXVOLUME));
     }
 
     len -= len1;
     stream += len1;
-    audio_buffer_->skip(len1);
+    audio_buf_index_ += len1;
+    playedBytes += len1;
+  }
+  if (playedBytes > 0 && bytesPerSample > 0) {
+    audio_samples_played_ += playedBytes / bytesPerSample;
+    markOutput();
   }
 
-  // Sync
-  // if (audio_clock_.current() >= 0) {
-  // audio_clock_.setTs(
-  //     audio_clock_.current() -
-  //     (double)(2 * is->audio_hw_buf_size + is->audio_write_buf_size) /
-  //         is->audio_tgt.bytes_per_sec);
-  // }
-}
-
-SDL_PixelFormatEnum SDLPlayer::convertFFmpegPixelFormatToSDLPixelFormat(
-    AVPixelFormat format) {
-  switch (format) {
-    case AV_PIX_FMT_YUVJ420P:
-    case AV_PIX_FMT_YUV420P:
-      return SDL_PIXELFORMAT_YV12;
-    case AV_PIX_FMT_YUV422P:
-      return SDL_PIXELFORMAT_YUY2;
-    case AV_PIX_FMT_YUV444P:
-      return SDL_PIXELFORMAT_IYUV;
-    case AV_PIX_FMT_RGB24:
-      return SDL_PIXELFORMAT_RGB24;
-    case AV_PIX_FMT_BGR24:
-      return SDL_PIXELFORMAT_BGR24;
-    case AV_PIX_FMT_RGBA:
-      return SDL_PIXELFORMAT_RGBA32;
-    case AV_PIX_FMT_BGRA:
-      return SDL_PIXELFORMAT_BGRA32;
-    case AV_PIX_FMT_ARGB:
-      return SDL_PIXELFORMAT_ARGB32;
-    case AV_PIX_FMT_ABGR:
-      return SDL_PIXELFORMAT_ABGR32;
-    default:
-      return SDL_PIXELFORMAT_UNKNOWN;
+  // Sync: the bytes written last become audible once the device played
+  // them and the buffer in front of them
+  if (std::isnan(audio_frame_end_) || audio_buf_size_ <= 0) return;
+  int bytesPerSec =
+      spec.freq * spec.channels * (SDL_AUDIO_BITSIZE(spec.format) / 8);
+  if (bytesPerSec <= 0) return;
+  double tempo = std::fabs(speed_.load());
+  double unplayed = (double)(audio_buf_size_ - audio_buf_index_) / bytesPerSec;
+  if (config_.common.unpaced) {
+    // virtual: the clock is what was written, it doesn't run on its own
+    audio_clock_.set(
+        (int64_t)((audio_frame_end_ - unplayed * tempo) * AV_TIME_BASE),
+        AV_TIME_BASE_Q, audio_frame_serial_, 0.0, callbackTime);
+    return;
   }
+  double latency =
+      (double)written / bytesPerSec + (double)spec.samples / spec.freq;
+  double audible = audio_frame_end_ - (unplayed + latency) * tempo;
+  audio_clock_.set((int64_t)(audible * AV_TIME_BASE), AV_TIME_BASE_Q,
+                   audio_frame_serial_, tempo, callbackTime);
+  syncExternalClock(audio_clock_, audio_frame_queue_.seq());
+}
+// takes the next decoded frame for the audio callback
+bool SDLPlayer::nextAudioFrame() {
+  AVFramePtr pFrame;
+  if (!audio_frame_queue_.pop(pFrame)) return false;
+
+  audio_frame_serial_ = audio_frame_queue_.seq();
+  audio_frame_ = pFrame;
+  audio_buf_index_ = 0;
+  audio_buf_size_ = av_samples_get_buffer_size(
+      nullptr, pFrame->channels, pFrame->nb_samples,
+      (AVSampleFormat)pFrame->format, 1);
+  if (audio_buf_size_ < 0) audio_buf_size_ = 0;
+
+  // a time stretched frame spans more or less media than its samples
+  auto timeBase = format_context_->streams[audio_stream_index_]->time_base;
+  int64_t start = frameTime(pFrame.get(), timeBase);
+  audio_frame_end_ =
+      start == AV_NOPTS_VALUE
+          ? NAN
+          : start / (double)AV_TIME_BASE +
+                (double)pFrame->nb_samples / pFrame->sample_rate *
+                    std::fabs(speed_.load());
+  return true;
 }
+
 int SDLPlayer::convertFFmpegSampleFormatToSDLSampleFormat(
     AVSampleFormat format) {
   switch (format) {
@@ -746,6 +1927,37 @@ int SDLPlayer::convertFFmpegSampleFormatToSDLSampleFormat(
   }
 }
 
+AVSampleFormat SDLPlayer::convertSDLSampleFormatToFFmpegSampleFormat(
+    SDL_AudioFormat format) {
+  switch (format) {
+    case AUDIO_F32:
+      return AV_SAMPLE_FMT_FLT;
+    case AUDIO_S16:
+      return AV_SAMPLE_FMT_S16;
+    case AUDIO_S32:
+      return AV_SAMPLE_FMT_S32;
+    case AUDIO_U8:
+      return AV_SAMPLE_FMT_U8;
+    default:
+      return AV_SAMPLE_FMT_NONE;
+  }
+}
+Uint16 SDLPlayer::latencyToSamples(int latencyMS, int sampleRate) {
+  int wanted = (int)((int64_t)sampleRate * latencyMS / 1000);
+  int samples = kMinAudioSamples;
+  while (samples < wanted && samples < kMaxAudioSamples) samples <<= 1;
+  return (Uint16)samples;
+}
+
+void SDLPlayer::setSinks(std::shared_ptr<VideoSink> videoSink,
+                         std::shared_ptr<AudioSink> audioSink) {
+  // the next play() configures them
+  video_sink_ = videoSink;
+  audio_sink_ = audioSink;
+  is_windowed_ = video_sink_.get() == static_cast<VideoSink *>(output_.get());
+  if (status_ == Player::READY) need2open_output_ = true;
+}
+
 void SDLPlayer::sdlAudioCallback(void *userdata, Uint8 *stream, int len) {
   SDLPlayer *player = static_cast<SDLPlayer *>(userdata);
   player->onSDLAudioPlay(stream, len);
@@ -771,35 +1983,462 @@ void SDLPlayer::onPauseToggle()
   }
 }
 
+void SDLPlayer::setIODeadline(int64_t timeoutMS) {
+  io_deadline_ = timeoutMS > 0 ? av_gettime_relative() + timeoutMS * 1000 : 0;
+}
+int SDLPlayer::scanInterruptCallback(void *opaque) {
+  SDLPlayer *player = static_cast<SDLPlayer *>(opaque);
+  return player->is_over_;
+}
+int SDLPlayer::interruptCallback(void *opaque) {
+  SDLPlayer *player = static_cast<SDLPlayer *>(opaque);
+  if (player->is_over_) return 1;
+  int64_t deadline = player->io_deadline_;
+  return deadline > 0 && av_gettime_relative() > deadline;
+}
+std::string SDLPlayer::errorString(int errnum) {
+  char buffer[AV_ERROR_MAX_STRING_SIZE]{};
+  av_strerror(errnum, buffer, sizeof(buffer));
+  return buffer;
+}
+
+SDLPlayer::Stats SDLPlayer::stats() const {
+  Stats stats;
+  for (int i = 0; i < STAGE_COUNT; i++)
+    stats.stages[i] = stage_latency_[i].summary();
+  stats.frame_cache = frame_cache_->stats();
+  stats.sync_error_us = sync_error_us_;
+  stats.frames = frames_presented_;
+  stats.audio_samples = audio_samples_played_;
+  int64_t start = output_start_us_, last = output_last_us_;
+  if (start != AV_NOPTS_VALUE && last != AV_NOPTS_VALUE)
+    stats.elapsed_us = last - start;
+  for (int i = 0; i < THREAD_COUNT; i++)
+    stats.threads[i] = threadUsage((PipelineThread)i);
+  stats.video_packets = video_packet_queue_.telemetry();
+  stats.video_frames = video_frame_queue_.telemetry();
+  stats.audio_packets = audio_packet_queue_.telemetry();
+  stats.audio_frames = audio_frame_queue_.telemetry();
+  stats.stalls = stalls_;
+  return stats;
+}
+
+SDLPlayer::Stats SDLPlayer::lastStats() const {
+  Mutex::lock locker(last_stats_mutex_);
+  return last_stats_;
+}
+
+void SDLPlayer::markOutput() {
+  int64_t now = av_gettime_relative();
+  int64_t unset = AV_NOPTS_VALUE;
+  output_start_us_.compare_exchange_strong(unset, now);
+  output_last_us_ = now;
+}
+
+// logged at close and reset for the next file
+void SDLPlayer::reportThroughput() {
+  Stats stats = this->stats();
+  if (stats.frames > 0 || stats.audio_samples > 0) {
+    {
+      Mutex::lock locker(last_stats_mutex_);
+      last_stats_ = stats;
+    }
+    LOG_INFO("[SDLPlayer] Throughput: {} frames ({:.1f} fps), {} audio "
+             "samples ({:.0f}/s) in {}us",
+             stats.frames, stats.fps(), stats.audio_samples,
+             stats.audioSamplesPerSecond(), stats.elapsed_us);
+    LOG_INFO("[SDLPlayer] Render stages: convert {}us, upload {}us, "
+             "present {}us",
+             stats.stages[STAGE_CONVERT].total_us,
+             stats.stages[STAGE_UPLOAD].total_us,
+             stats.stages[STAGE_PRESENT].total_us);
+    for (int i = 0; i < THREAD_COUNT; i++) {
+      const ThreadUsage &usage = stats.threads[i];
+      if (usage.cpu_us == 0) continue;
+      LOG_INFO("[SDLPlayer] {} thread: {}us CPU, {} voluntary and {} "
+               "involuntary context switches",
+               threadName((PipelineThread)i), usage.cpu_us,
+               usage.voluntary_switches, usage.involuntary_switches);
+    }
+  }
+  frames_presented_ = audio_samples_played_ = 0;
+  output_start_us_ = output_last_us_ = AV_NOPTS_VALUE;
+  read_thread_.resetUsage();
+  video_decode_thread_.resetUsage();
+  audio_decode_thread_.resetUsage();
+  render_probe_.reset();
+  audio_callback_probe_.reset();
+}
+
+// polls the stall detector while playing, paused or seeking is no stall
+void SDLPlayer::onWatchStalls() {
+  Tracer::setThreadName("stall watchdog");
+  auto interval = std::chrono::microseconds(
+      FFMIN(FFMAX(stall_detector_->timeout() / 4, 10000), 250000));
+  bool wasWatching = false;
+  while (!is_over_) {
+    {
+      Mutex::ulock locker(stall_mutex_);
+      stall_cond_.wait_for(locker, interval, [this] { return is_over_.load(); });
+    }
+    if (is_over_) break;
+    int64_t now = av_gettime_relative();
+    bool isWatching = status() == Player::PLAYING && !need2seek_ &&
+                      !is_scrubbing_ && !need2open_output_;
+    if (!isWatching) {
+      wasWatching = false;
+      continue;
+    }
+    if (!wasWatching) {
+      stall_detector_->restart(now);
+      wasWatching = true;
+      continue;
+    }
+    for (const auto &stall : stall_detector_->poll(now)) onStall(stall);
+  }
+}
+
+void SDLPlayer::onStall(const StallDetector::Stall &stall) {
+  StallEvent event;
+  event.stage = (PipelineStage)stall.stage;
+  event.duration_ms = stall.duration_us / 1000;
+  event.is_recovered = stall.is_recovered;
+  if (stall.is_recovered) {
+    event.cause = event.stage;
+    LOG_INFO("[SDLPlayer] {} recovered after {}ms", stageName(event.stage),
+             event.duration_ms);
+  } else {
+    stalls_++;
+    event.cause = stallCause(event.stage);
+    LOG_WARN("[SDLPlayer] {} made no progress for {}ms, held up by {}",
+             stageName(event.stage), event.duration_ms,
+             stageName(event.cause));
+  }
+  if (stall_listener_) stall_listener_(event);
+}
+
+// follows empty queues upstream and full queues downstream to the stage
+// that is stuck itself
+SDLPlayer::PipelineStage SDLPlayer::stallCause(PipelineStage stage) const {
+  switch (stage) {
+    case STAGE_READ:
+      if (enable_video_ &&
+          video_packet_queue_.depth() >= video_packet_queue_.maxSize())
+        return stallCause(STAGE_VIDEO_DECODE);
+      if (enable_audio_ &&
+          audio_packet_queue_.depth() >= audio_packet_queue_.maxSize())
+        return stallCause(STAGE_AUDIO_DECODE);
+      return STAGE_READ;
+    case STAGE_VIDEO_DECODE:
+      if (video_packet_queue_.depth() == 0 && !is_finished_) return STAGE_READ;
+      if (video_frame_queue_.depth() >= video_frame_queue_.maxSize())
+        return STAGE_PRESENT;
+      return STAGE_VIDEO_DECODE;
+    case STAGE_PRESENT:
+      if (video_frame_queue_.depth() == 0) return stallCause(STAGE_VIDEO_DECODE);
+      return STAGE_PRESENT;
+    case STAGE_AUDIO_DECODE:
+      if (audio_packet_queue_.depth() == 0 && !is_finished_) return STAGE_READ;
+      if (audio_frame_queue_.depth() >= audio_frame_queue_.maxSize())
+        return STAGE_AUDIO_CALLBACK;
+      return STAGE_AUDIO_DECODE;
+    case STAGE_AUDIO_CALLBACK:
+      if (audio_frame_queue_.depth() == 0) return stallCause(STAGE_AUDIO_DECODE);
+      return STAGE_AUDIO_CALLBACK;
+    default:
+      return stage;
+  }
+}
+
+std::string SDLPlayer::metrics() const {
+  fmt::memory_buffer out;
+  auto it = std::back_inserter(out);
+  auto header = [&](const char *name, const char *type, const char *help) {
+    fmt::format_to(it, "# HELP xplayer_{} {}\n# TYPE xplayer_{} {}\n",
+                   name, help, name, type);
+  };
+  auto metric = [&](const char *name, const char *type, const char *help,
+                    double value) {
+    header(name, type, help);
+    fmt::format_to(it, "xplayer_{} {}\n", name, value);
+  };
+
+  // counters start over with every file
+  metric("playing", "gauge", "1 while playing.",
+         status() == Player::PLAYING ? 1 : 0);
+  metric("read_packets_total", "counter", "Packets read by the demuxer.",
+         (double)demux_stats_.packets);
+  metric("read_packets_dropped_total", "counter",
+         "Packets read but not decoded, unselected streams and trick play.",
+         (double)demux_stats_.dropped_packets);
+  metric("read_bytes_total", "counter", "Bytes the demuxer advanced through.",
+         (double)demux_stats_.io_bytes);
+  metric("seeks_total", "counter", "Demuxer seeks.",
+         (double)demux_stats_.seeks);
+  metric("seeks_failed_total", "counter",
+         "Demuxer seeks which failed or timed out.",
+         (double)demux_stats_.failed_seeks);
+  auto videoFrames = video_frame_queue_.telemetry();
+  auto audioFrames = audio_frame_queue_.telemetry();
+  metric("video_frames_decoded_total", "counter", "Video frames decoded.",
+         (double)videoFrames.pushes);
+  metric("video_frames_dropped_total", "counter",
+         "Decoded video frames flushed before they were presented.",
+         (double)videoFrames.flushed);
+  metric("video_frames_presented_total", "counter", "Video frames presented.",
+         (double)frames_presented_);
+  metric("audio_frames_decoded_total", "counter", "Audio frames decoded.",
+         (double)audioFrames.pushes);
+  metric("audio_samples_played_total", "counter",
+         "Samples per channel passed to the audio output.",
+         (double)audio_samples_played_);
+  metric("av_sync_error_seconds", "gauge",
+         "Video minus master clock at the last scheduled frame.",
+         sync_error_us_ / 1e6);
+  metric("stalls_total", "counter",
+         "Pipeline stages without progress for the stall timeout.",
+         (double)stalls_);
+
+  struct Queue
+  {
+    const char *name;
+    size_t capacity;
+    AVQueueTelemetry t;
+  };
+  const Queue queues[] = {
+      {"video_packet", video_packet_queue_.maxSize(),
+       video_packet_queue_.telemetry()},
+      {"video_frame", video_frame_queue_.maxSize(), videoFrames},
+      {"audio_packet", audio_packet_queue_.maxSize(),
+       audio_packet_queue_.telemetry()},
+      {"audio_frame", audio_frame_queue_.maxSize(), audioFrames},
+  };
+  auto queueMetric = [&](const char *name, const char *type, const char *help,
+                         auto value) {
+    header(name, type, help);
+    for (const auto &queue : queues)
+      fmt::format_to(it, "xplayer_{}{{queue=\"{}\"}} {}\n", name,
+                     queue.name, value(queue));
+  };
+  queueMetric("queue_depth", "gauge", "Items in the queue.",
+              [](const Queue &q) { return (double)q.t.depth; });
+  queueMetric("queue_capacity", "gauge", "Items the queue holds at most.",
+              [](const Queue &q) { return (double)q.capacity; });
+  queueMetric("queue_high_water", "gauge", "Highest depth of the file.",
+              [](const Queue &q) { return (double)q.t.high_water; });
+  queueMetric("queue_underruns_total", "counter",
+              "Pops finding the queue just ran empty.",
+              [](const Queue &q) { return (double)q.t.underruns; });
+  queueMetric("queue_overruns_total", "counter",
+              "Pushes finding the queue full.",
+              [](const Queue &q) { return (double)q.t.overruns; });
+  queueMetric("queue_push_blocked_seconds_total", "counter",
+              "Time producers waited for room.",
+              [](const Queue &q) { return q.t.push_blocked_us / 1e6; });
+  queueMetric("queue_pop_blocked_seconds_total", "counter",
+              "Time consumers found the queue empty.",
+              [](const Queue &q) { return q.t.pop_blocked_us / 1e6; });
+
+  auto threadMetric = [&](const char *name, const char *help, auto value) {
+    header(name, "counter", help);
+    for (int i = 0; i < THREAD_COUNT; i++) {
+      std::string thread = threadName((PipelineThread)i);
+      std::replace(thread.begin(), thread.end(), ' ', '_');
+      fmt::format_to(it, "xplayer_{}{{thread=\"{}\"}} {}\n", name, thread,
+                     value(threadUsage((PipelineThread)i)));
+    }
+  };
+  threadMetric("thread_cpu_seconds_total", "CPU time of a pipeline thread.",
+               [](const ThreadUsage &u) { return u.cpu_us / 1e6; });
+  threadMetric("thread_voluntary_switches_total",
+               "Context switches a thread gave up the CPU for, waits and I/O.",
+               [](const ThreadUsage &u) {
+                 return (double)u.voluntary_switches;
+               });
+  threadMetric("thread_involuntary_switches_total",
+               "Context switches a thread was preempted by, CPU contention.",
+               [](const ThreadUsage &u) {
+                 return (double)u.involuntary_switches;
+               });
+
+  // the stage histograms on fixed bounds, 100us to 1s
+  static const int64_t kBoundsUS[] = {100,    250,    500,    1000,   2500,
+                                      5000,   10000,  25000,  50000,  100000,
+                                      250000, 500000, 1000000};
+  constexpr int kBounds = sizeof(kBoundsUS) / sizeof(kBoundsUS[0]);
+  header("stage_duration_seconds", "histogram",
+         "Time spent in a pipeline stage, see SDLPlayer::PipelineStage.");
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    std::string stage = stageName((PipelineStage)i);
+    std::replace(stage.begin(), stage.end(), ' ', '_');
+    const LatencyHistogram &histogram = stage_latency_[i];
+    int64_t counts[kBounds];
+    histogram.countsAtMost(kBoundsUS, counts, kBounds);
+    LatencyHistogram::Summary summary = histogram.summary();
+    for (int b = 0; b < kBounds; b++)
+      fmt::format_to(it,
+                     "xplayer_stage_duration_seconds_bucket{{stage=\"{}\","
+                     "le=\"{}\"}} {}\n",
+                     stage, kBoundsUS[b] / 1e6, counts[b]);
+    // read separately from the buckets, +Inf may trail them slightly
+    int64_t count = FFMAX(summary.count, counts[kBounds - 1]);
+    fmt::format_to(it,
+                   "xplayer_stage_duration_seconds_bucket{{stage=\"{}\","
+                   "le=\"+Inf\"}} {}\n",
+                   stage, count);
+    fmt::format_to(it,
+                   "xplayer_stage_duration_seconds_sum{{stage=\"{}\"}} {}\n",
+                   stage, summary.total_us / 1e6);
+    fmt::format_to(it,
+                   "xplayer_stage_duration_seconds_count{{stage=\"{}\"}} "
+                   "{}\n",
+                   stage, count);
+  }
+  return fmt::to_string(out);
+}
+
+const char *SDLPlayer::threadName(PipelineThread thread) {
+  switch (thread) {
+    case THREAD_READ:
+      return "read";
+    case THREAD_VIDEO_DECODE:
+      return "video decode";
+    case THREAD_AUDIO_DECODE:
+      return "audio decode";
+    case THREAD_RENDER:
+      return "render";
+    case THREAD_AUDIO_CALLBACK:
+      return "audio callback";
+    default:
+      return "unknown";
+  }
+}
+
+ThreadUsage SDLPlayer::threadUsage(PipelineThread thread) const {
+  switch (thread) {
+    case THREAD_READ:
+      return read_thread_.usage();
+    case THREAD_VIDEO_DECODE:
+      return video_decode_thread_.usage();
+    case THREAD_AUDIO_DECODE:
+      return audio_decode_thread_.usage();
+    case THREAD_RENDER:
+      return render_probe_.sample();
+    case THREAD_AUDIO_CALLBACK:
+      return audio_callback_probe_.sample();
+    default:
+      return ThreadUsage();
+  }
+}
+
+const char *SDLPlayer::stageName(PipelineStage stage) {
+  switch (stage) {
+    case STAGE_READ:
+      return "read";
+    case STAGE_VIDEO_DECODE:
+      return "video decode";
+    case STAGE_VIDEO_QUEUE:
+      return "video queue";
+    case STAGE_CONVERT:
+      return "convert";
+    case STAGE_UPLOAD:
+      return "upload";
+    case STAGE_PRESENT:
+      return "present";
+    case STAGE_AUDIO_DECODE:
+      return "audio decode";
+    case STAGE_AUDIO_CALLBACK:
+      return "audio callback";
+    default:
+      return "unknown";
+  }
+}
+
 void SDLPlayer::videoDelay()
 {
-  // microseconds
-  int64_t delayUS =
-    AV_TIME_BASE / config_.video.frame_rate / config_.common.speed;
-  if (isAVStreamBoth()) {
-    int syncThreshold = FFMAX(0.04f, FFMIN(delayUS, 0.1f)) * AV_TIME_BASE;
-    auto diff = video_clock_.current() - audio_clock_.current();
-    if (diff < 10 * AV_TIME_BASE) {  // 10 secs
-      if (diff <= -syncThreshold) {
+  if (config_.common.unpaced) return;
+  // seconds, the nominal duration of a frame at the playback speed
+  double delay =
+      1.0 / config_.video.frame_rate / std::fabs(speed_.load());
+  if (syncMode() != PlayerConfig::VIDEO_MASTER) {
+    double diff = video_clock_.get() - masterClock();
+    if (!std::isnan(diff)) reportSyncError((int64_t)(diff * AV_TIME_BASE));
+
+    // skip or repeat frames to catch up with the master clock
+    double syncThreshold =
+        FFMAX(kSyncThresholdMin, FFMIN(kSyncThresholdMax, delay));
+    if (!std::isnan(diff) && std::fabs(diff) < kNoSyncThreshold) {
+      if (diff <= -syncThreshold)
         // video is slow
-        delayUS = FFMAX(0, delayUS + diff);
-      }
-      else if (diff >= syncThreshold) {
-        auto up = std::ceil(AV_TIME_BASE / (config_.video.frame_rate * config_.common.speed));
-        if (delayUS > up)
-          // video is too fast
-          delayUS = delayUS + diff;
-        else
-          // video is too slow
-          delayUS = 2 * delayUS;
-      }
+        delay = FFMAX(0.0, delay + diff);
+      else if (diff >= syncThreshold && delay > kSyncFramedupThreshold)
+        // video is too fast
+        delay = delay + diff;
+      else if (diff >= syncThreshold)
+        delay = 2 * delay;
     }
   }
-  else {
-    int64_t elapseUS = clocker_.elapse();
-    delayUS = FFMAX(0, delayUS - elapseUS);
-  }
+
+  // frames are due at fixed steps, the time spent converting and
+  // presenting is taken from the sleep
+  double now = AVMediaClock::now();
+  if (std::isnan(frame_timer_) || now - frame_timer_ > kSyncThresholdMax)
+    frame_timer_ = now;
+  frame_timer_ += delay;
+  int64_t delayUS = (int64_t)((frame_timer_ - now) * AV_TIME_BASE);
 
   LOG_DEBUG("Delay: {}us", delayUS);
-  std::this_thread::sleep_for(std::chrono::microseconds{delayUS});
+  if (delayUS > 0)
+    std::this_thread::sleep_for(std::chrono::microseconds{delayUS});
+}
+
+PlayerConfig::SyncMode SDLPlayer::syncMode() const {
+  if (is_reversing_ || trick_mode_ != TRICK_NONE) return PlayerConfig::VIDEO_MASTER;
+  switch (config_.common.sync_mode) {
+    case PlayerConfig::AUDIO_MASTER:
+      return enable_audio_ ? PlayerConfig::AUDIO_MASTER
+                           : PlayerConfig::VIDEO_MASTER;
+    case PlayerConfig::VIDEO_MASTER:
+      return enable_video_ ? PlayerConfig::VIDEO_MASTER
+                           : PlayerConfig::AUDIO_MASTER;
+    default:
+      return PlayerConfig::EXTERNAL_MASTER;
+  }
+}
+double SDLPlayer::masterClock() const {
+  switch (syncMode()) {
+    case PlayerConfig::AUDIO_MASTER:
+      return audio_clock_.get(audio_frame_queue_.seq());
+    case PlayerConfig::VIDEO_MASTER:
+      return video_clock_.get(video_frame_queue_.seq());
+    default:
+      return external_clock_.get(seq_);
+  }
+}
+void SDLPlayer::syncExternalClock(const AVMediaClock &slave, int serial) {
+  // until a seek is shown the slaves still run on the old position
+  if (seek_request_time_ != 0) return;
+  double slaveClock = slave.get(serial);
+  double externalClock = external_clock_.get(seq_);
+  if (std::isnan(slaveClock)) return;
+  if (std::isnan(externalClock) ||
+      std::fabs(externalClock - slaveClock) > kNoSyncThreshold)
+    external_clock_.set((int64_t)(slaveClock * AV_TIME_BASE), AV_TIME_BASE_Q,
+                        seq_, std::fabs(speed_.load()));
+}
+// aggregated per window so the log stays readable
+void SDLPlayer::reportSyncError(int64_t errorUS) {
+  sync_error_us_ = errorUS;
+  sync_error_sum_us_ += std::abs(errorUS);
+  sync_error_max_us_ = FFMAX(sync_error_max_us_, std::abs(errorUS));
+  sync_error_count_++;
+
+  double now = AVMediaClock::now();
+  if (std::isnan(sync_report_time_)) sync_report_time_ = now;
+  if (now - sync_report_time_ < kSyncReportInterval) return;
+  LOG_INFO("[SDLPlayer] A/V sync error: avg {}us, max {}us over {} frames",
+           sync_error_sum_us_ / sync_error_count_, sync_error_max_us_,
+           sync_error_count_);
+  sync_error_sum_us_ = sync_error_max_us_ = sync_error_count_ = 0;
+  sync_report_time_ = now;
 }
@@ -0,0 +1,47 @@
+#include "xplayer/StallDetector.h"
+
+#include "xplayer/FFmpegUtil.h"
+
+std::shared_ptr<StallDetector> StallDetector::create(int64_t timeoutMS) {
+  return std::make_shared<StallDetector>(timeoutMS * 1000);
+}
+
+void StallDetector::addStage(int stage, Progress progress, Expected expected) {
+  int64_t value = progress();
+  stages_.push_back({stage, std::move(progress), std::move(expected), value,
+                     av_gettime_relative(), false});
+}
+
+void StallDetector::clear() { stages_.clear(); }
+
+void StallDetector::restart(int64_t nowUS) {
+  for (auto &stage : stages_) {
+    stage.last_value = stage.progress();
+    stage.last_change_us = nowUS;
+    stage.is_stalled = false;
+  }
+}
+
+std::vector<StallDetector::Stall> StallDetector::poll(int64_t nowUS) {
+  std::vector<Stall> stalls;
+  for (auto &stage : stages_) {
+    int64_t value = stage.progress();
+    if (value != stage.last_value) {
+      if (stage.is_stalled)
+        stalls.push_back({stage.id, nowUS - stage.last_change_us, true});
+      stage.last_value = value;
+      stage.last_change_us = nowUS;
+      stage.is_stalled = false;
+    } else if (!stage.expected()) {
+      // idle isn't stalled, the timer starts when there is work again
+      stage.last_change_us = nowUS;
+      stage.is_stalled = false;
+    } else if (!stage.is_stalled &&
+               nowUS - stage.last_change_us >= timeout_us_) {
+      stage.is_stalled = true;
+      stalls_.fetch_add(1, std::memory_order_relaxed);
+      stalls.push_back({stage.id, nowUS - stage.last_change_us, false});
+    }
+  }
+  return stalls;
+}
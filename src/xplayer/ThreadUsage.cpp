@@ -0,0 +1,119 @@
+#include "xplayer/ThreadUsage.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+
+ThreadUsage ThreadUsage::self() {
+  ThreadUsage usage;
+#ifdef __linux__
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+    usage.cpu_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  struct rusage ru;
+  if (getrusage(RUSAGE_THREAD, &ru) == 0) {
+    usage.voluntary_switches = ru.ru_nvcsw;
+    usage.involuntary_switches = ru.ru_nivcsw;
+  }
+#endif
+  return usage;
+}
+
+int ThreadProbe::currentTid() {
+#ifdef __linux__
+  return (int)syscall(SYS_gettid);
+#else
+  return 0;
+#endif
+}
+
+void ThreadProbe::attach() {
+#ifdef __linux__
+  clockid_t clock;
+  if (pthread_getcpuclockid(pthread_self(), &clock) != 0)
+    clock = CLOCK_THREAD_CPUTIME_ID;
+  clock_ = clock;
+#endif
+  tid_ = currentTid();
+  ThreadUsage usage = ThreadUsage::self();
+  base_cpu_us_ = usage.cpu_us;
+  base_voluntary_switches_ = usage.voluntary_switches;
+  base_involuntary_switches_ = usage.involuntary_switches;
+  store(ThreadUsage{});
+  is_attached_ = true;
+}
+
+void ThreadProbe::detach() {
+  if (!isCurrent()) return;
+  is_attached_ = false;
+  store(ThreadUsage::self() - base());
+}
+
+void ThreadProbe::reset() {
+  is_attached_ = false;
+  tid_ = 0;
+  store(ThreadUsage{});
+}
+
+bool ThreadProbe::isCurrent() const {
+  int tid = tid_;
+  return tid != 0 && tid == currentTid();
+}
+
+// the clock id works from other threads, the switch counts come from
+// /proc as getrusage() only covers the caller. Both fail once the thread
+// is gone.
+ThreadUsage ThreadProbe::sample() const {
+  ThreadUsage last;
+  last.cpu_us = cpu_us_;
+  last.voluntary_switches = voluntary_switches_;
+  last.involuntary_switches = involuntary_switches_;
+  if (!is_attached_) return last;
+  if (isCurrent()) {
+    ThreadUsage usage = ThreadUsage::self() - base();
+    store(usage);
+    return usage;
+  }
+
+  ThreadUsage usage;
+#ifdef __linux__
+  struct timespec ts;
+  if (clock_gettime(clock_, &ts) != 0) return last;
+  usage.cpu_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+  char path[64];
+  std::snprintf(path, sizeof(path), "/proc/self/task/%d/status", (int)tid_);
+  std::FILE *file = std::fopen(path, "r");
+  if (!file) return last;
+  char line[256];
+  long long value;
+  while (std::fgets(line, sizeof(line), file)) {
+    if (std::sscanf(line, "voluntary_ctxt_switches: %lld", &value) == 1)
+      usage.voluntary_switches = value;
+    else if (std::sscanf(line, "nonvoluntary_ctxt_switches: %lld", &value) == 1)
+      usage.involuntary_switches = value;
+  }
+  std::fclose(file);
+#endif
+  // detached meanwhile, its final values are newer
+  if (!is_attached_) return sample();
+  usage = usage - base();
+  store(usage);
+  return usage;
+}
+
+ThreadUsage ThreadProbe::base() const {
+  return {base_cpu_us_, base_voluntary_switches_, base_involuntary_switches_};
+}
+
+void ThreadProbe::store(const ThreadUsage &usage) const {
+  cpu_us_ = usage.cpu_us;
+  voluntary_switches_ = usage.voluntary_switches;
+  involuntary_switches_ = usage.involuntary_switches;
+}
@@ -0,0 +1,146 @@
+#include "xplayer/Tracer.h"
+
+#include <cstdlib>
+#include <fstream>
+
+#include "xplayer/Log.h"
+
+std::atomic<bool> Tracer::enabled_{false};
+
+namespace {
+thread_local const char *tls_thread_name = nullptr;
+thread_local void *tls_buffer = nullptr;
+std::atomic<int> next_tid{1};
+
+std::string escapeJson(const std::string &s) {
+  std::string out;
+  out.reserve(s.size());
+  for (char c : s) {
+    if (c == '"' || c == '\\') out.push_back('\\');
+    if ((unsigned char)c < 0x20) continue;
+    out.push_back(c);
+  }
+  return out;
+}
+}  // namespace
+
+// never destroyed, threads may still trace while the process exits
+Tracer &Tracer::instance() {
+  static Tracer *tracer = new Tracer();
+  return *tracer;
+}
+
+void Tracer::start(const std::string &path, size_t eventsPerThread) {
+  {
+    Mutex::lock locker(mutex_);
+    path_ = path;
+    capacity_ = eventsPerThread > 0 ? eventsPerThread : 1;
+    if (!exit_hook_) {
+      exit_hook_ = true;
+      std::atexit([] {
+        Tracer &tracer = Tracer::instance();
+        tracer.stop();
+        std::string path;
+        {
+          Mutex::lock locker(tracer.mutex_);
+          path = tracer.path_;
+        }
+        if (!path.empty()) tracer.exportJson(path);
+      });
+    }
+  }
+  enabled_ = true;
+  LOG_INFO("[Tracer] Tracing, {} events per thread", eventsPerThread);
+}
+
+void Tracer::stop() { enabled_ = false; }
+
+void Tracer::clear() {
+  Mutex::lock locker(mutex_);
+  for (auto &buffer : buffers_) {
+    Mutex::lock bufferLocker(buffer->mutex);
+    buffer->next = 0;
+    buffer->wrapped = false;
+  }
+}
+
+void Tracer::setThreadName(const char *name) {
+  tls_thread_name = name;
+  auto *buffer = static_cast<ThreadBuffer *>(tls_buffer);
+  if (buffer) {
+    Mutex::lock locker(buffer->mutex);
+    buffer->name = name;
+  }
+}
+
+void Tracer::record(const Event &event) {
+  ThreadBuffer *buffer = threadBuffer();
+  Mutex::lock locker(buffer->mutex);
+  if (buffer->events.empty()) return;
+  buffer->events[buffer->next] = event;
+  if (++buffer->next == buffer->events.size()) {
+    buffer->next = 0;
+    buffer->wrapped = true;
+  }
+}
+
+// registered on the first event of a thread
+Tracer::ThreadBuffer *Tracer::threadBuffer() {
+  if (tls_buffer) return static_cast<ThreadBuffer *>(tls_buffer);
+
+  auto buffer = std::make_unique<ThreadBuffer>();
+  buffer->tid = next_tid++;
+  if (tls_thread_name) buffer->name = tls_thread_name;
+  Mutex::lock locker(mutex_);
+  buffer->events.resize(capacity_);
+  tls_buffer = buffer.get();
+  buffers_.push_back(std::move(buffer));
+  return static_cast<ThreadBuffer *>(tls_buffer);
+}
+
+bool Tracer::exportJson(const std::string &path) const {
+  std::ofstream ofs(path, std::ios::trunc);
+  if (!ofs) {
+    LOG_WARN("[Tracer] Could not write {}", path);
+    return false;
+  }
+
+  size_t count = 0;
+  ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  Mutex::lock locker(mutex_);
+  for (auto &buffer : buffers_) {
+    Mutex::lock bufferLocker(buffer->mutex);
+    if (!buffer->name.empty()) {
+      ofs << (count++ ? ",\n" : "\n")
+          << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+          << buffer->tid << ",\"args\":{\"name\":\""
+          << escapeJson(buffer->name) << "\"}}";
+    }
+    // oldest first
+    size_t size = buffer->wrapped ? buffer->events.size() : buffer->next;
+    size_t first = buffer->wrapped ? buffer->next : 0;
+    for (size_t i = 0; i < size; i++) {
+      const Event &event = buffer->events[(first + i) % buffer->events.size()];
+      ofs << (count++ ? ",\n" : "\n") << "{\"ph\":\"X\",\"name\":\""
+          << event.name << "\",\"pid\":1,\"tid\":" << buffer->tid
+          << ",\"ts\":" << event.ts << ",\"dur\":" << event.dur
+          << ",\"args\":{";
+      const char *separator = "";
+      if (event.stream >= 0) {
+        ofs << "\"stream\":" << event.stream;
+        separator = ",";
+      }
+      if (event.pts != AV_NOPTS_VALUE) {
+        ofs << separator << "\"pts\":" << event.pts;
+        separator = ",";
+      }
+      if (event.serial >= 0) ofs << separator << "\"serial\":" << event.serial;
+      ofs << "}}";
+    }
+  }
+  ofs << "\n]}\n";
+  if (!ofs) return false;
+
+  LOG_INFO("[Tracer] Wrote {} events to {}", count, path);
+  return true;
+}
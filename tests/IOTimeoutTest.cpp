@@ -0,0 +1,346 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SyntheticMedia.h"
+#include "xplayer/Log.h"
+#include "xplayer/SDLPlayer.h"
+
+namespace {
+
+constexpr int64_t kTimeoutMS = 500;
+// scheduling and teardown on a loaded machine
+constexpr int64_t kSlackMS = 1000;
+
+int64_t elapsedMS(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// A player on the headless sinks reading a FIFO in a directory of its own
+class IOTimeoutTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    setBaseLogLevel(LWARN);
+    char dir[] = "/tmp/xplayer_test_XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    dir_ = dir;
+    fifo_ = dir_ + "/input";
+    ASSERT_EQ(mkfifo(fifo_.c_str(), 0600), 0);
+
+    config_.video.width = -1;
+    config_.video.height = -1;
+    config_.common.keyframe_index = false;
+    config_.common.stall_timeout_ms = 0;
+    config_.io.open_timeout_ms = kTimeoutMS;
+    config_.io.read_timeout_ms = kTimeoutMS;
+    config_.io.seek_timeout_ms = kTimeoutMS;
+    config_.output.headless = true;
+    config_.play_after_ready = false;
+    player_ = SDLPlayer::create(config_);
+    ASSERT_NE(player_, nullptr);
+  }
+
+  void TearDown() override {
+    if (player_) player_->destroy();
+    stopWriter();
+    unlink(fifo_.c_str());
+    rmdir(dir_.c_str());
+  }
+
+  // writes the first bytes of data, then keeps the FIFO open without
+  // writing more. O_RDWR never waits for a reader and never gets EPIPE.
+  void startWriter(std::vector<char> data, size_t bytes) {
+    writer_fd_ = open(fifo_.c_str(), O_RDWR | O_NONBLOCK);
+    ASSERT_GE(writer_fd_, 0);
+    writer_ = std::thread([this, data = std::move(data), bytes] {
+      size_t written = 0;
+      size_t end = std::min(bytes, data.size());
+      while (!stop_writer_ && written < end) {
+        ssize_t n = write(writer_fd_, data.data() + written, end - written);
+        if (n > 0)
+          written += (size_t)n;
+        else
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+  }
+
+  void stopWriter() {
+    stop_writer_ = true;
+    if (writer_.joinable()) writer_.join();
+    if (writer_fd_ >= 0) close(writer_fd_);
+    writer_fd_ = -1;
+  }
+
+protected:
+  std::string dir_;
+  std::string fifo_;
+  PlayerConfig config_;
+  std::shared_ptr<SDLPlayer> player_;
+  int writer_fd_{-1};
+  std::thread writer_;
+  std::atomic_bool stop_writer_{false};
+};
+
+std::vector<char> readFile(const std::string &path) {
+  std::ifstream ifs(path, std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(ifs),
+                           std::istreambuf_iterator<char>());
+}
+
+bool waitUntil(const std::function<bool()> &done, int64_t timeoutMS) {
+  auto start = std::chrono::steady_clock::now();
+  while (!done()) {
+    if (elapsedMS(start) > timeoutMS) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return true;
+}
+
+// Serves a file over HTTP with byte ranges, on the loopback. After stall()
+// it sends nothing more: bodies stop where they are and new requests are
+// accepted but never answered, the input stays seekable but hangs.
+class StallingHttpServer {
+public:
+  explicit StallingHttpServer(std::vector<char> data)
+      : data_(std::move(data)) {}
+  ~StallingHttpServer() { stop(); }
+
+  bool start() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) return false;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(listen_fd_, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd_, 8) < 0 ||
+        getsockname(listen_fd_, (sockaddr *)&addr, &len) < 0)
+      return false;
+    port_ = ntohs(addr.sin_port);
+    accept_thread_ = std::thread([this] { onAccept(); });
+    return true;
+  }
+  void stop() {
+    is_stopped_ = true;
+    if (accept_thread_.joinable()) accept_thread_.join();
+    // only the accept thread adds to them
+    for (auto &connection : connections_) connection.join();
+    connections_.clear();
+    if (listen_fd_ >= 0) close(listen_fd_);
+    listen_fd_ = -1;
+  }
+  void stall() { is_stalled_ = true; }
+  std::string url(const std::string &name) const {
+    return fmt::format("http://127.0.0.1:{}/{}", port_, name);
+  }
+
+private:
+  // false once stopped
+  bool waitFor(int fd, short events) {
+    pollfd pfd{fd, events, 0};
+    while (!is_stopped_) {
+      int r = poll(&pfd, 1, 20);
+      if (r > 0) return true;
+      if (r < 0 && errno != EINTR) return false;
+    }
+    return false;
+  }
+  void hold() {
+    while (!is_stopped_)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  bool sendAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+      if (is_stalled_) {
+        hold();
+        return false;
+      }
+      if (!waitFor(fd, POLLOUT)) return false;
+      ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+      if (n < 0 && errno != EAGAIN && errno != EINTR) return false;
+      if (n > 0) {
+        data += n;
+        size -= (size_t)n;
+      }
+    }
+    return true;
+  }
+
+  void onAccept() {
+    while (waitFor(listen_fd_, POLLIN)) {
+      int fd = accept4(listen_fd_, nullptr, nullptr,
+                       SOCK_CLOEXEC | SOCK_NONBLOCK);
+      if (fd < 0) continue;
+      connections_.emplace_back([this, fd] {
+        onConnection(fd);
+        close(fd);
+      });
+    }
+  }
+  void onConnection(int fd) {
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+      if (!waitFor(fd, POLLIN)) return;
+      ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+      if (n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+      if (n <= 0) return;
+      request.append(buffer, (size_t)n);
+    }
+    if (is_stalled_) {
+      hold();
+      return;
+    }
+
+    size_t size = data_.size();
+    size_t offset = 0;
+    size_t range = request.find("Range: bytes=");
+    if (range != std::string::npos)
+      offset = std::min<size_t>(
+          strtoull(request.c_str() + range + strlen("Range: bytes="), nullptr,
+                   10),
+          size);
+    std::string header =
+        range != std::string::npos && offset < size
+            ? fmt::format("HTTP/1.1 206 Partial Content\r\n"
+                          "Content-Range: bytes {}-{}/{}\r\n",
+                          offset, size - 1, size)
+            : "HTTP/1.1 200 OK\r\n";
+    header += fmt::format(
+        "Content-Length: {}\r\nAccept-Ranges: bytes\r\n"
+        "Connection: close\r\n\r\n",
+        size - offset);
+    // in pieces, so a stall stops the body where it is
+    if (!sendAll(fd, header.data(), header.size())) return;
+    while (offset < size) {
+      size_t piece = std::min<size_t>(size - offset, 4096);
+      if (!sendAll(fd, data_.data() + offset, piece)) return;
+      offset += piece;
+    }
+  }
+
+private:
+  std::vector<char> data_;
+  int listen_fd_{-1};
+  int port_{0};
+  std::thread accept_thread_;
+  std::vector<std::thread> connections_;
+  std::atomic_bool is_stalled_{false};
+  std::atomic_bool is_stopped_{false};
+};
+
+}  // namespace
+
+TEST_F(IOTimeoutTest, OpenWithoutWriterFails) {
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_FALSE(player_->openUrl(fifo_));
+  EXPECT_LT(elapsedMS(start), kTimeoutMS + kSlackMS);
+}
+
+TEST_F(IOTimeoutTest, OpenSilentWriterTimesOut) {
+  startWriter({}, 0);
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_FALSE(player_->openUrl(fifo_));
+  EXPECT_LT(elapsedMS(start), kTimeoutMS + kSlackMS);
+}
+
+// probing waits on the silent writer until close() aborts it
+TEST_F(IOTimeoutTest, CloseAbortsAsyncOpen) {
+  config_.io.open_timeout_ms = 60 * 1000;
+  ASSERT_TRUE(player_->init(config_));
+  startWriter({}, 0);
+  auto future = player_->openUrlAsync(fifo_);
+  std::this_thread::sleep_for(std::chrono::milliseconds(kTimeoutMS));
+
+  auto start = std::chrono::steady_clock::now();
+  player_->close();
+  EXPECT_LT(elapsedMS(start), kSlackMS);
+  // the open ended before close() returned
+  ASSERT_EQ(future.wait_for(std::chrono::milliseconds(0)),
+            std::future_status::ready);
+  EXPECT_FALSE(future.get());
+  EXPECT_EQ(player_->status(), Player::INITED);
+}
+
+// the writer stalls after the first seconds of an MPEG-TS clip: the read
+// thread waits on the FIFO while the player is closed
+TEST_F(IOTimeoutTest, CloseOnStalledInput) {
+  ClipSpec spec;
+  spec.name = "test_stalled_ts";
+  spec.width = 320;
+  spec.height = 240;
+  spec.container = "mpegts";
+  spec.extension = "ts";
+  std::string path = syntheticClip(spec);
+  ASSERT_FALSE(path.empty());
+  std::vector<char> data = readFile(path);
+  ASSERT_FALSE(data.empty());
+  startWriter(data, data.size() / 4);
+
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_TRUE(player_->openUrl(fifo_)) << player_->lastError();
+  EXPECT_LT(elapsedMS(start), kTimeoutMS + kSlackMS);
+
+  // past what was written, the read thread is blocked on the FIFO
+  std::this_thread::sleep_for(std::chrono::milliseconds(2 * kTimeoutMS));
+  start = std::chrono::steady_clock::now();
+  player_->close();
+  EXPECT_LT(elapsedMS(start), kTimeoutMS + kSlackMS);
+}
+
+// a FIFO can't be sought at all, an HTTP input can: it is served until the
+// player opened it, then hangs. The seek reaches the demuxer, fails at its
+// deadline, and the player keeps going.
+TEST_F(IOTimeoutTest, SeekOnStalledInputTimesOut) {
+  ClipSpec spec;
+  spec.name = "test_http_ts";
+  spec.width = 320;
+  spec.height = 240;
+  spec.seconds = 60;  // longer than the packet queues hold
+  spec.container = "mpegts";
+  spec.extension = "ts";
+  std::string path = syntheticClip(spec);
+  ASSERT_FALSE(path.empty());
+  StallingHttpServer server(readFile(path));
+  ASSERT_TRUE(server.start());
+
+  ASSERT_TRUE(player_->openUrl(server.url("clip.ts")))
+      << player_->lastError();
+  ASSERT_GT(player_->getTotalTime(), 40000);
+  server.stall();
+
+  // the demuxer seeks by reading timestamps, over a new request
+  player_->seek(40000);
+  ASSERT_TRUE(waitUntil([&] { return player_->demuxStats().seeks > 0; },
+                        2 * kTimeoutMS + kSlackMS));
+  EXPECT_EQ(player_->demuxStats().failed_seeks, 1);
+  EXPECT_GE(player_->lastSeekTime() / 1000, kTimeoutMS - 10);
+  EXPECT_LT(player_->lastSeekTime() / 1000, kTimeoutMS + kSlackMS);
+  EXPECT_NE(player_->status(), Player::BROKEN);
+
+  auto start = std::chrono::steady_clock::now();
+  player_->close();
+  EXPECT_LT(elapsedMS(start), kTimeoutMS + kSlackMS);
+}
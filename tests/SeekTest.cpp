@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "SyntheticMedia.h"
+#include "xplayer/Log.h"
+#include "xplayer/SDLPlayer.h"
+
+namespace {
+
+constexpr int kFps = 30;
+
+bool waitUntil(const std::function<bool()> &done, int64_t timeoutMS) {
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMS);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > deadline) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return true;
+}
+
+// A paused player on the headless sinks rendering on its own thread, over
+// a video-only clip with a keyframe every 5 seconds
+class SeekTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    setBaseLogLevel(LWARN);
+    ClipSpec spec;
+    spec.name = "test_long_gop";
+    spec.width = 320;
+    spec.height = 240;
+    spec.fps = kFps;
+    spec.gop = 5 * kFps;
+    spec.audio_codec.clear();
+    path_ = syntheticClip(spec);
+    ASSERT_FALSE(path_.empty());
+
+    config_.video.width = -1;
+    config_.video.height = -1;
+    config_.video.frame_cache_mb = 0;  // every seek goes to the demuxer
+    config_.common.keyframe_index = false;
+    config_.output.headless = true;
+    config_.play_after_ready = false;
+  }
+
+  void TearDown() override {
+    if (!player_) return;
+    // played to the end, the render loop closes the media
+    if (render_thread_.joinable()) {
+      player_->seek(FFMAX(player_->getTotalTime() - 200, 0));
+      player_->replay();
+      render_thread_.join();
+    }
+    player_->destroy();
+  }
+
+  void start() {
+    player_ = SDLPlayer::create(config_);
+    ASSERT_NE(player_, nullptr);
+    ASSERT_TRUE(player_->openUrl(path_)) << player_->lastError();
+    render_thread_ = std::thread([this] { player_->play(); });
+    ASSERT_TRUE(waitUntil(
+        [this] { return !std::isnan(player_->videoClock()); }, 5000));
+    ASSERT_TRUE(player_->pause());
+  }
+
+protected:
+  std::string path_;
+  PlayerConfig config_;
+  std::shared_ptr<SDLPlayer> player_;
+  std::thread render_thread_;
+};
+
+}  // namespace
+
+// accurate_seek is only what seek() defaults to: the accurate seek ending
+// a scrub lands on the target, not on the keyframe before it
+TEST_F(SeekTest, EndScrubIsAccurateWithoutAccurateSeek) {
+  config_.common.accurate_seek = false;
+  ASSERT_NO_FATAL_FAILURE(start());
+
+  player_->scrub(7000);
+  player_->endScrub();
+  ASSERT_TRUE(waitUntil([this] { return !player_->isSeeking(); }, 5000));
+  double shown = player_->videoClock();
+  EXPECT_GE(shown, 7.0 - 1.0 / kFps);
+  EXPECT_LE(shown, 7.0 + 2.0 / kFps);
+}
+
+// the keyframe before the target is shown by a plain seek then
+TEST_F(SeekTest, SeekLandsOnKeyframeWithoutAccurateSeek) {
+  config_.common.accurate_seek = false;
+  ASSERT_NO_FATAL_FAILURE(start());
+
+  player_->seek(7000);
+  ASSERT_TRUE(waitUntil([this] { return !player_->isSeeking(); }, 5000));
+  EXPECT_NEAR(player_->videoClock(), 5.0, 1.0 / kFps);
+}